@@ -7,6 +7,13 @@
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#ifdef __unix__
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 // IMPORTED LIBS //////////////////////////////////////////////////////////////////////////
 #define STB_IMAGE_IMPLEMENTATION
@@ -14,6 +21,9 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "lib/stb_image_write.h"
 
+// KERNELS ////////////////////////////////////////////////////////////////////////////////
+#include "seam_carving_kernels.h"
+
 // MACROS ////////////////////////////////////////////////////////////////////////////////
 #define max(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -31,25 +41,106 @@
 #define SEAM UINT_MAX - 1
 #define ENERGY_CHANNEL_COUNT 1
 #define UNDEFINED_UINT UINT_MAX
+#define TRAPEZOID_BASE_CELLS 16384  // Trapezoids with fewer cells are computed directly (only amortizes the recursion)
+#define TRAPEZOID_TASK_CELLS 65536  // Trapezoids with fewer cells don't spawn tasks
+#define INCREMENTAL_PARALLEL_CELLS 4096  // Dirty intervals with fewer cells are recalculated by one thread
+#define FUSED_BAND_ROWS 32  // Rows the fused engine removes and updates in one band (at least one per thread)
+#define MULTI_SEAMS_PER_PASS_DEFAULT 16  // Seams the multi engine extracts from one cumulative energy plane
+#define TRANSPOSE_TILE 16  // Pixels per side of a transpose tile (its 2 x 16 rows are 32 pages, within the L1 TLB)
+#define SEAM_BLOCK_DEFAULT 32  // Seams the alternate seam order removes in one orientation before it switches
+#define SEAM_MAP_MAGIC "SCMP"  // First bytes of a seam order map file
+#define SEAM_ORDER_KEPT USHRT_MAX  // Seam order map value of the pixels that are never removed
+#define SERVE_WORKERS_DEFAULT 4  // Requests the service handles at the same time
+#define SERVE_CACHE_DEFAULT 16  // Source images (with their energy planes and seam order maps) the service keeps
+#define SERVE_CACHE_MAPS 4  // Seam order maps (of different options) the service keeps per source image
+#define SERVE_ACCEPT_BACKOFF 10000  // Microseconds a worker waits before it accepts again when out of descriptors or memory
+#define SERVE_REQUEST_LENGTH 4096  // Longest request line
+#define SERVE_REQUEST_ARGS 32  // Most arguments of a request
 
 // USER DEFINES ////////////////////////////////////////////////////////////////////////////
 #define SAVE_TIMING_STATS
 // #define SAVE_DEBUG_IMAGE
 // #define RENDER_LOADING_BAR_WIDTH 50
+#define COMPACT_ENERGY  // 16 bit energy plane (the cumulative energy stays 32 bit, see "Compact energy" in seam_carving_kernels.h)
+
+#ifdef COMPACT_ENERGY
+typedef unsigned short EnergyValue;
+#define ENERGY_KERNEL(kernel) seamKernels.kernel##16
+#else
+typedef unsigned int EnergyValue;
+#define ENERGY_KERNEL(kernel) seamKernels.kernel
+#endif
 
 int outputDebugCount = 0;
 
 typedef struct __ImageProcessData__
 {
     unsigned char* img;
-    unsigned int* imgEnergy;
+    unsigned char* imgLuminance;    // Luminance plane the energy is calculated from (NULL for the per-channel energy)
+    EnergyValue* imgEnergy;         // NULL with streaming energy (calculated inside the DP instead)
     unsigned int* imgSeam;
-    int* seamPath;
+    unsigned char* seamDirections;  // Packed 2-bit backpointers of the rolling DP (imgSeam then only has 2 rows)
+    unsigned int* seamTransfers;    // Banded min-plus transfer matrices of the row blocks (minplus engine)
+    int* seamPath;      // Seams of the last pass, row-major (seam s of row y at seamPath[y * seamCount + s], sorted by x)
+    int seamCount;      // Seams in seamPath
+    int seamsPerPass;   // Seams the annotate step may extract in this pass (only the multi engine uses more than one)
+    unsigned long long seamEnergy;  // Total energy of the removed seam pixels (to compare engines)
+    bool energyCurrent;             // imgEnergy already matches img (taken from the service cache), the next carve skips it
+    int* pixelColumns;              // Source column of every pixel, compacted with the image (only while a seam order map is recorded)
+    unsigned short* seamOrderMap;   // Seam every source pixel was removed with (source width x height, NULL unless recorded)
     int width;
     int height;
+    int stride;  // Pixels per row of img, imgLuminance, imgEnergy and imgSeam (the original width, rows are compacted in place)
     int channelCount;
 } ImageProcessData;
 
+typedef enum __CarvingEngine__
+{
+    ENGINE_DEFAULT,     // One parallel region per step (and per DP row)
+    ENGINE_PERSISTENT,  // One parallel region around the whole seam loop
+    ENGINE_TRAPEZOID,   // Cache-oblivious trapezoid decomposition of the DP (tasks)
+    ENGINE_INCREMENTAL, // Only recalculate the cumulative energy in the dependency cone of the removed seam
+    ENGINE_ROLLING,     // Two cumulative energy rows and a packed direction map instead of the full plane
+    ENGINE_MULTI,       // Several non-crossing seams backtracked from one cumulative energy plane and removed together
+    ENGINE_MINPLUS,     // Row blocks in parallel, joined through their min-plus transfer matrices (parallel in height)
+    ENGINE_BIDIRECTIONAL, // Top-down and bottom-up DP meeting in the middle row (half the serial chain)
+    ENGINE_FUSED,       // Remove, energy update and DP of a seam fused into one band wavefront
+    ENGINE_COUNT
+} CarvingEngine;
+
+static const char* carvingEngineNames[ENGINE_COUNT] = { "default", "persistent", "trapezoid", "incremental", "rolling", "multi", "minplus", "bidirectional", "fused" };
+
+typedef enum __SeamOrder__
+{
+    SEAM_ORDER_VERTICAL_FIRST,    // All vertical seams, then all horizontal seams
+    SEAM_ORDER_HORIZONTAL_FIRST,  // All horizontal seams, then all vertical seams
+    SEAM_ORDER_ALTERNATE,         // Blocks of seams in both orientations, so both reach their target at the same time
+    SEAM_ORDER_OPTIMAL,           // The order with the least total seam energy (transport map DP)
+    SEAM_ORDER_COUNT
+} SeamOrder;
+
+static const char* seamOrderNames[SEAM_ORDER_COUNT] = { "vertical", "horizontal", "alternate", "optimal" };
+
+static const char* energyFunctionNames[ENERGY_FUNCTION_COUNT] = { "sobel", "sobel-l1", "gradient", "forward" };
+
+typedef void (*SeamIdentificationFunc)(ImageProcessData* data);
+typedef void (*SeamAnnotateFunc)(ImageProcessData* data);
+
+typedef struct __ProcessOptions__
+{
+    CarvingEngine engine;
+    int seamsPerPass;
+    bool streamingEnergy;
+    bool luminance;
+    EnergyFunction energyFunction;
+    int targetWidth;     // 0: width - seam count argument
+    int targetHeight;    // 0: the height stays the same
+    SeamOrder seamOrder;
+    int seamBlock;       // Seams per orientation block of the alternate order
+    const char* seamMapOut;  // Record the seam order map of the carved seams into this file (NULL: no map)
+    const char* seamMapIn;   // Build the output from this seam order map instead of carving (NULL: carve)
+} ProcessOptions;
+
 typedef struct __TimingStats__
 {
     double totalProcessingTime;
@@ -57,9 +148,90 @@ typedef struct __TimingStats__
     double seamIdentifications;
     double seamAnnotates;
     double seamRemoves;
+    double seamInserts;
+    double transposes;
     int cpus;
 } TimingStats;
 
+typedef struct __DriftStats__
+{
+    unsigned long long seamEnergy;       // Total energy of the removed seam pixels
+    unsigned long long exactSeamEnergy;  // Same for the exact one seam at a time result
+    double seamEnergyIncrease;           // seamEnergy relative to exactSeamEnergy (0 if both are 0)
+    double changedPixels;                // Share of output pixels that differ from the exact result
+    double meanAbsoluteError;            // Mean absolute difference per channel to the exact result
+} DriftStats;
+
+typedef struct __TransportState__
+{
+    unsigned char* img;       // Image after r horizontal and c vertical seams (packed, stride == width)
+    unsigned long long cost;  // Seam energy of the cheapest seam order that reaches the state
+    bool transposed;          // img is transposed (the last seam was horizontal)
+} TransportState;
+
+/// Seam order map file: the header, then the seam order of every source pixel (unsigned short, row-major, source width x
+/// height), any width down to width - seamCount can be built from the source image and the map
+typedef struct __SeamMapHeader__
+{
+    char magic[4];  // SEAM_MAP_MAGIC
+    int width;      // Source image size
+    int height;
+    int seamCount;  // Seams recorded in the map
+} SeamMapHeader;
+
+#ifdef __unix__
+typedef struct __CachedSeamMap__
+{
+    unsigned short* seamOrderMap;  // Seam order map of the source
+    int seamCount;                 // Seams in seamOrderMap
+    ProcessOptions options;        // Options the map was recorded with (engine, seams per pass and energy source)
+    int references;                // Requests applying the map, a replaced map is freed by the last one
+    bool replaced;
+    unsigned long long lastUse;    // Map use counter of the entry (least recently used goes first)
+} CachedSeamMap;
+
+typedef struct __CachedImage__
+{
+    char* path;
+    unsigned char* img;            // Decoded source image (packed, the requests carve copies of it, NULL if decoding failed)
+    int width;
+    int height;
+    int channelCount;
+    EnergyValue* imgEnergy[2];     // Energy planes of the source per energy source (1 for luminance, NULL until calculated)
+    CachedSeamMap* seamMaps[SERVE_CACHE_MAPS];  // Seam order maps of the source, one per option set (seamMapMatches)
+    int seamMapCount;
+    unsigned long long mapUseCounter;
+    int references;                // Requests that use the entry, an evicted entry is freed by the last one
+    bool evicted;
+    unsigned long long lastUse;    // Cache use counter of the last request (least recently used goes first)
+    omp_lock_t lock;               // Held while the image is decoded, then guards imgEnergy and seamMaps
+} CachedImage;
+
+typedef struct __ImageCache__
+{
+    CachedImage** entries;
+    int entryCount;
+    int capacity;
+    unsigned long long useCounter;
+    omp_lock_t lock;  // Guards the entry list, references and lastUse
+} ImageCache;
+
+typedef struct __ServiceStats__
+{
+    unsigned long long requests;
+    unsigned long long errors;
+    unsigned long long imageHits;
+    unsigned long long imageMisses;
+    unsigned long long energyHits;
+    unsigned long long energyMisses;
+    unsigned long long mapHits;
+    unsigned long long mapMisses;
+    double totalLatency;
+    double maxLatency;
+    double totalProcessingTime;
+} ServiceStats;
+#endif
+
 // FUNCTIONS //////////////////////////////////////////////////////////////////////////////
 /// @brief Get the index of a pixel given the dimensions and channel count
 static inline unsigned int getPixelIdxC(int x, int y, int width, int channelCount)
@@ -91,8 +263,8 @@ static inline unsigned char *getPixel(unsigned char *data, int x, int y, int wid
     return &data[pixelIdx];
 }
 
-/// @brief Get the pixel data at the given position (with bounds check)
-static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int width, int height, int channelCount)  // Only used for energy calculation
+/// @brief Get the pixel data at the given position (with bounds check, rows are stride pixels apart)
+static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount)  // Only used for energy calculation
 {
     // if x and y outside bounds, use the closest pixel
     if (x < 0)       x = 0;
@@ -100,11 +272,11 @@ static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int wi
     if (x >= width)  x = width - 1;
     if (y >= height) y = height - 1;
 
-    return getPixel(data, x, y, width, height, channelCount);
+    return getPixel(data, x, y, stride, height, channelCount);
 }
 
 /// @brief Get the energy pixel data at the given position
-static inline unsigned int getEnergyPixel(unsigned int* data, int x, int y, int width, int height)
+static inline unsigned int getEnergyPixel(EnergyValue* data, int x, int y, int width, int height)
 {
     // if x and y outside bounds, return undefined
     if (x < 0 || y < 0 || x >= width || y >= height)
@@ -116,7 +288,7 @@ static inline unsigned int getEnergyPixel(unsigned int* data, int x, int y, int
 }
 
 /// @brief Get the energy pixel data at the given position (with bounds check)
-static inline unsigned int getEnergyPixelE(unsigned int* data, int x, int y, int width, int height)
+static inline unsigned int getEnergyPixelE(EnergyValue* data, int x, int y, int width, int height)
 {
     unsigned int energy = getEnergyPixel(data, x, y, width, height);
     if (energy == UNDEFINED_UINT)
@@ -134,40 +306,112 @@ static inline bool isSeam(ImageProcessData* data, int x, int y)
         return false;
     }
 
-    return data->seamPath[y] == x;
+    for (int seamIdx = 0; seamIdx < data->seamCount; seamIdx++)
+    {
+        if (data->seamPath[y * data->seamCount + seamIdx] == x)
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-/// @brief Calculate the energy of a pixel using the sobel operator
-static inline unsigned int calculatePixelEnergy(unsigned char *data, int x, int y, int width, int height, int channelCount)
+/// @brief Calculate the energy of a pixel with an energy function, generated for a channel count (CHANNELS interleaved,
+/// the first ENERGY_CHANNELS take part, see "Channel count kernels" and "Energy functions" in seam_carving_kernels.h)
+#define PIXEL_ENERGY_KERNEL(name, CHANNELS, ENERGY_CHANNELS, ENERGY_FUNCTION)                                         \
+    static unsigned int name(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount)  \
+    {                                                                                                                 \
+        (void) channelCount; /* Only the generic kernels read the channel count */                                    \
+        const unsigned char* a = getPixelE(data, x - 1, y - 1, width, height, stride, CHANNELS);                      \
+        const unsigned char* b = getPixelE(data,     x, y - 1, width, height, stride, CHANNELS);                      \
+        const unsigned char* c = getPixelE(data, x + 1, y - 1, width, height, stride, CHANNELS);                      \
+        const unsigned char* d = getPixelE(data, x - 1,     y, width, height, stride, CHANNELS);                      \
+        const unsigned char* f = getPixelE(data, x + 1,     y, width, height, stride, CHANNELS);                      \
+        const unsigned char* g = getPixelE(data, x - 1, y + 1, width, height, stride, CHANNELS);                      \
+        const unsigned char* h = getPixelE(data,     x, y + 1, width, height, stride, CHANNELS);                      \
+        const unsigned char* i = getPixelE(data, x + 1, y + 1, width, height, stride, CHANNELS);                      \
+                                                                                                                      \
+        int energy = 0;                                                                                               \
+        for (int rgbChannel = 0; rgbChannel < ENERGY_CHANNELS; rgbChannel++)                                          \
+        {                                                                                                             \
+            energy += channelEnergy(ENERGY_FUNCTION, a[rgbChannel], b[rgbChannel], c[rgbChannel], d[rgbChannel],      \
+                                    f[rgbChannel], g[rgbChannel], h[rgbChannel], i[rgbChannel]);                      \
+        }                                                                                                             \
+                                                                                                                      \
+        return energy / ENERGY_CHANNELS;                                                                              \
+    }
+
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelGray, 1, 1, ENERGY_SOBEL)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelRGB, 3, 3, ENERGY_SOBEL)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelRGBA, 4, 3, ENERGY_SOBEL)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelGeneric, channelCount, getEnergyChannelCount(channelCount), ENERGY_SOBEL)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelL1Gray, 1, 1, ENERGY_SOBEL_L1)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelL1RGB, 3, 3, ENERGY_SOBEL_L1)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelL1RGBA, 4, 3, ENERGY_SOBEL_L1)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergySobelL1Generic, channelCount, getEnergyChannelCount(channelCount), ENERGY_SOBEL_L1)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergyGradientGray, 1, 1, ENERGY_GRADIENT)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergyGradientRGB, 3, 3, ENERGY_GRADIENT)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergyGradientRGBA, 4, 3, ENERGY_GRADIENT)
+PIXEL_ENERGY_KERNEL(calculatePixelEnergyGradientGeneric, channelCount, getEnergyChannelCount(channelCount), ENERGY_GRADIENT)
+
+typedef unsigned int (*PixelEnergyKernel)(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount);
+
+/// @brief Pixel energy kernels by [energy function][gray, RGB, RGBA, generic]
+static const PixelEnergyKernel pixelEnergyKernels[PIXEL_ENERGY_FUNCTION_COUNT][4] =
+{
+    { calculatePixelEnergySobelGray,    calculatePixelEnergySobelRGB,    calculatePixelEnergySobelRGBA,    calculatePixelEnergySobelGeneric },
+    { calculatePixelEnergySobelL1Gray,  calculatePixelEnergySobelL1RGB,  calculatePixelEnergySobelL1RGBA,  calculatePixelEnergySobelL1Generic },
+    { calculatePixelEnergyGradientGray, calculatePixelEnergyGradientRGB, calculatePixelEnergyGradientRGBA, calculatePixelEnergyGradientGeneric },
+};
+
+static PixelEnergyKernel pixelEnergyKernel = calculatePixelEnergySobelGeneric;
+static PixelEnergyKernel pixelEnergyGrayKernel = calculatePixelEnergySobelGray;  // For the luminance plane
+
+/// @brief Select the pixel energy kernels of the energy function and the image's channel count (once per image, forward
+/// energy has no per pixel energy and keeps the sobel kernels for seamEnergy)
+static inline void pixelEnergyKernelInit(int channelCount, EnergyFunction energyFunction)
 {
-    int energy = 0;
-    for (int rgbChannel = 0; rgbChannel < channelCount; rgbChannel++)
+    const PixelEnergyKernel* kernels = pixelEnergyKernels[energyFunction < PIXEL_ENERGY_FUNCTION_COUNT ? energyFunction : ENERGY_SOBEL];
+    switch (channelCount)
     {
-        int Gx = -     getPixelE(data, x - 1, y - 1, width, height, channelCount)[rgbChannel]
-                 - 2 * getPixelE(data, x - 1,     y, width, height, channelCount)[rgbChannel]
-                 -     getPixelE(data, x - 1, y + 1, width, height, channelCount)[rgbChannel]
-                 +     getPixelE(data, x + 1, y - 1, width, height, channelCount)[rgbChannel]
-                 + 2 * getPixelE(data, x + 1,     y, width, height, channelCount)[rgbChannel]
-                 +     getPixelE(data, x + 1, y + 1, width, height, channelCount)[rgbChannel];
+        case 1:  pixelEnergyKernel = kernels[0]; break;
+        case 3:  pixelEnergyKernel = kernels[1]; break;
+        case 4:  pixelEnergyKernel = kernels[2]; break;
+        default: pixelEnergyKernel = kernels[3]; break;
+    }
+    pixelEnergyGrayKernel = kernels[0];
+}
+
+/// @brief Calculate the energy of a pixel with the selected energy function
+static inline unsigned int calculatePixelEnergy(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount)
+{
+    return pixelEnergyKernel(data, x, y, width, height, stride, channelCount);
+}
 
-        int Gy = +     getPixelE(data, x - 1, y - 1, width, height, channelCount)[rgbChannel]
-                 + 2 * getPixelE(data,     x, y - 1, width, height, channelCount)[rgbChannel]
-                 +     getPixelE(data, x + 1, y - 1, width, height, channelCount)[rgbChannel]
-                 -     getPixelE(data, x - 1, y + 1, width, height, channelCount)[rgbChannel]
-                 - 2 * getPixelE(data,     x, y + 1, width, height, channelCount)[rgbChannel]
-                 -     getPixelE(data, x + 1, y + 1, width, height, channelCount)[rgbChannel];
+/// @brief Get the image the energy is calculated from (the luminance plane if there is one) and its channel count
+static inline unsigned char* getEnergyImage(const ImageProcessData* data, int* channelCount)
+{
+    *channelCount = data->imgLuminance != NULL ? 1 : data->channelCount;
+    return data->imgLuminance != NULL ? data->imgLuminance : data->img;
+}
 
-        energy += sqrt(pow(Gx, 2) + pow(Gy, 2));
+/// @brief Calculate the energy of a pixel of the process data (from the luminance plane if there is one)
+static inline unsigned int calculateDataPixelEnergy(const ImageProcessData* data, int x, int y)
+{
+    if (data->imgLuminance != NULL)
+    {
+        return pixelEnergyGrayKernel(data->imgLuminance, x, y, data->width, data->height, data->stride, 1);
     }
 
-    return energy / channelCount;
+    return calculatePixelEnergy(data->img, x, y, data->width, data->height, data->stride, data->channelCount);
 }
 
 #ifdef SAVE_DEBUG_IMAGE
 /// @brief Output the debug image with the seam annotated and energy values
 void outputDebugImage(ImageProcessData* processData, char* imageOutPath)
 {
-    int debugWidth = processData->width + 1; // + 1 because it was reduced by 1 in refreshProcessData
+    int debugWidth = processData->width + processData->seamCount; // + seamCount because it was reduced in seamRemove
     int debugHeight = processData->height;
     int debugChannelCount = 3;
     unsigned char *debugImgData = (unsigned char *) malloc(sizeof(unsigned char *) * debugWidth * debugHeight * debugChannelCount);
@@ -186,10 +430,11 @@ void outputDebugImage(ImageProcessData* processData, char* imageOutPath)
             }
             else
             {
-                unsigned int pixelPos = getPixelIdx(x, y, debugWidth);
-                pixel[0] = processData->imgEnergy[pixelPos];
-                pixel[1] = processData->imgEnergy[pixelPos];
-                pixel[2] = processData->imgEnergy[pixelPos];
+                unsigned int pixelPos = getPixelIdx(x, y, processData->stride);
+                unsigned char energy = processData->imgEnergy != NULL ? processData->imgEnergy[pixelPos] : 0;
+                pixel[0] = energy;
+                pixel[1] = energy;
+                pixel[2] = energy;
             }
         }
     }
@@ -202,6 +447,38 @@ void outputDebugImage(ImageProcessData* processData, char* imageOutPath)
 }
 #endif
 
+/// @brief Calculate the luminance plane of the image (one byte per pixel with the image's stride), RGB is weighted with
+/// the integer BT.601 weights (77, 150, 29) / 256, grayscale images keep their gray channel
+static inline void calculateLuminance(ImageProcessData* data)
+{
+    const int channelCount = data->channelCount;
+    data->imgLuminance = (unsigned char *) malloc(sizeof(unsigned char) * data->stride * data->height);
+
+    /// Parallel:
+    // - rows are independent, the plane is calculated once and then compacted with the image (seamRemoveRowInPlace)
+    #pragma omp parallel for
+    for (int y = 0; y < data->height; y++)
+    {
+        const unsigned char* src = &data->img[getPixelIdxC(0, y, data->stride, channelCount)];
+        unsigned char* dst = &data->imgLuminance[getPixelIdx(0, y, data->stride)];
+        if (channelCount >= 3)
+        {
+            for (int x = 0; x < data->width; x++)
+            {
+                const unsigned char* pixel = &src[x * channelCount];
+                dst[x] = (unsigned char) ((77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2] + 128) >> 8);
+            }
+        }
+        else
+        {
+            for (int x = 0; x < data->width; x++)
+            {
+                dst[x] = src[x * channelCount];
+            }
+        }
+    }
+}
+
 /// @brief Calculate the energy of all pixels in the image
 static inline void calculateEnergyFull(ImageProcessData* data)
 {
@@ -210,20 +487,69 @@ static inline void calculateEnergyFull(ImageProcessData* data)
     }
 
     // Allocate space for energy and calculate energy for each pixel
-    data->imgEnergy = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
+    data->imgEnergy = (EnergyValue *) malloc(sizeof(EnergyValue) * data->stride * data->height);
 
     /// Parallel:
     // - Tested looping with one for loop through all data but is consistently slower in parallel and in sequential.
     // - Tested collapse(2) but also seems to be slower.
     // - Standard approach is probably the best, as each thread gets a couple of rows (as cache lines) and every pixel calculation is independent
+    // - Each row is computed by the widest SIMD energy kernel the CPU supports, on a padded copy of the image
+    //   so no pixel needs a bounds check (see seam_carving_kernels.h)
+    int energyChannelCount;
+    const unsigned char* energyImg = getEnergyImage(data, &energyChannelCount);
+
+    PaddedImage padded;
+    paddedImageAlloc(&padded, data->width, data->height, energyChannelCount);
+
     #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int x = 0; x < data->width; x++)
+        paddedImageFillRow(&padded, energyImg, data->stride, y);
+    }
+    paddedImageFillBorderRows(&padded);
+
+    #pragma omp parallel for
+    for (int y = 0; y < data->height; y++)
+    {
+        ENERGY_KERNEL(energyRow)(&padded, &data->imgEnergy[getPixelIdx(0, y, data->stride)], y);
+    }
+
+    paddedImageFree(&padded);
+}
+
+/// @brief Update the energy of one row in place after the seams were removed (img and width are already the new ones)
+static inline void updateEnergyOnSeamRowInPlace(ImageProcessData* data, int y)
+{
+    EnergyValue* energyRow = &data->imgEnergy[getPixelIdx(0, y, data->stride)];
+    const int seamCount = data->seamCount;
+    const int oldWidth = data->width + seamCount;
+
+    // Get data.
+    const int* seamX1 = &data->seamPath[y * seamCount];
+    const int* seamX0 = y > 0 ? seamX1 - seamCount : seamX1;
+    const int* seamX2 = y < data->height - 1 ? seamX1 + seamCount : seamX1;
+
+    // Move the energy between the seams to the left
+    seamCompactRow(energyRow, seamX1, seamCount, oldWidth, sizeof(EnergyValue));
+
+    // Recalculate the pixels that were next to a seam in the old image (oldX within 1 of the seam in rows y - 1, y, y + 1),
+    // the seams don't cross, so seam s is the same seam in all three rows and its window lies right of seam s - 1 in row y
+    int removedLeft = 0;  // Seams of row y left of oldX
+    for (int seamIdx = 0; seamIdx < seamCount; seamIdx++)
+    {
+        int oldXStart = max(min(min(seamX0[seamIdx], seamX1[seamIdx]), seamX2[seamIdx]) - 1, 0);
+        int oldXEnd = min(max(max(seamX0[seamIdx], seamX1[seamIdx]), seamX2[seamIdx]) + 1, oldWidth - 1);
+        for (int oldX = oldXStart; oldX <= oldXEnd; oldX++)
         {
-            unsigned int pixelIdx = getPixelIdx(x, y, data->width);
-            unsigned int energy = calculatePixelEnergy(data->img, x, y, data->width, data->height, data->channelCount);
-            data->imgEnergy[pixelIdx] = energy;
+            while (removedLeft > 0 && seamX1[removedLeft - 1] >= oldX) removedLeft--;
+            while (removedLeft < seamCount && seamX1[removedLeft] < oldX) removedLeft++;
+            if (removedLeft < seamCount && seamX1[removedLeft] == oldX)
+            {
+                continue;  // Removed pixel
+            }
+
+            int x = oldX - removedLeft;
+            energyRow[x] = calculateDataPixelEnergy(data, x, y);
         }
     }
 }
@@ -231,218 +557,2766 @@ static inline void calculateEnergyFull(ImageProcessData* data)
 /// @brief Update the energy of the pixels on the seam instead of updating the whole energy image
 void updateEnergyOnSeam(ImageProcessData* data)
 {
-    unsigned int *imgEnergyNew = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
+    /// Parallel:
+    // - rows keep their fixed stride, so compacting and recalculating row y only writes row y (reads of img rows
+    //   y - 1 and y + 1 see the already compacted image), every row is independent
+    #pragma omp parallel for
+    for (int y = 0; y < data->height; y++)
+    {
+        updateEnergyOnSeamRowInPlace(data, y);
+    }
+}
+
+/// @brief Copy the energy of the columns [xStart, xEnd) into a cumulative energy row (widened to 32 bit with
+/// COMPACT_ENERGY)
+static inline void seamRowCopyEnergy(unsigned int* seamRow, const EnergyValue* energyRow, int xStart, int xEnd)
+{
+    for (int x = xStart; x < xEnd; x++)
+    {
+        seamRow[x] = energyRow[x];
+    }
+}
 
-    int oldWidth = data->width + 1;
+/// @brief Prepare the cumulative energy plane for the current width and fill its bottom row with energy values
+/// (the plane is allocated once for the original width, only the guard columns move as the image narrows)
+static inline void seamPlanePrepare(ImageProcessData* data)
+{
+    if (data->imgSeam == NULL)
+    {
+        data->imgSeam = seamPlaneAlloc(data->stride, data->height);
+    }
 
-    #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int x = 0; x < oldWidth; x++)
+        seamRowSetGuards(getSeamRow(data->imgSeam, y, data->stride), data->width);
+    }
+
+    seamRowCopyEnergy(getSeamRow(data->imgSeam, data->height - 1, data->stride),
+                      &data->imgEnergy[getPixelIdx(0, data->height - 1, data->stride)], 0, data->width);
+}
+
+/// @brief Calculate the cumulative energy of the image from the bottom to the top
+void seamIdentification(ImageProcessData* data)
+{
+    // Reuse the seam plane and fill the bottom row with energy values
+    seamPlanePrepare(data);
+
+    /// Parallel:
+    // - each row has to be calculated before starting the next row, we can only parallelize calc of a row
+    // - each thread gets one contiguous range of the row and runs the DP row kernel of the selected SIMD tier on it
+    for (int y = data->height - 2; y >= 0; y--)
+    {
+        #pragma omp parallel
         {
-            // Get data.
-            int seamX0 = y > 0 ? data->seamPath[y - 1] : INT_MAX;
-            int seamX1 = data->seamPath[y];
-            int seamX2 = y < data->height - 1 ? data->seamPath[y + 1] : INT_MAX;
+            int xStart, xEnd;
+            getThreadRange(data->width, THREAD_RANGE_ALIGN, omp_get_thread_num(), omp_get_num_threads(), &xStart, &xEnd);
+            ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, y + 1, data->stride),
+                                 &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                 getSeamRow(data->imgSeam, y, data->stride),
+                                 xStart, xEnd);
+        }
+    }
+}
+
+/// @brief Calculate the cumulative energy without an energy plane, the energy of a row is calculated just before the
+/// DP needs it from a ring of padded image rows
+void streamingSeamIdentification(ImageProcessData* data)
+{
+    const int width = data->width;
+    const int height = data->height;
+
+    // Allocate once for the original width
+    if (data->imgSeam == NULL)
+    {
+        data->imgSeam = seamPlaneAlloc(data->stride, height);
+    }
+
+    int energyChannelCount;
+    const unsigned char* energyImg = getEnergyImage(data, &energyChannelCount);
+
+    PaddedImage ring;
+    paddedRingAlloc(&ring, width, energyChannelCount);
+    EnergyValue* energyRow = (EnergyValue *) malloc(sizeof(EnergyValue) * width);
+
+    // The bottom border row, the bottom row and the row above it are in the ring before the first energy row
+    paddedRingFillRow(&ring, energyImg, data->stride, height - 1, height);
+    paddedRingFillRow(&ring, energyImg, data->stride, height - 1, height - 1);
+    paddedRingFillRow(&ring, energyImg, data->stride, max(height - 2, 0), height - 2);
+
+    /// Parallel:
+    // - one parallel region, one barrier per row, every thread calculates the energy of its columns of the row and
+    //   runs the DP on them right away (the DP of a column range only needs the energy of that range)
+    // - thread 0 also copies the image row two rows up into the ring (the ring slot it writes is none of the three
+    //   the energy kernels read in this step) and sets the guards of the row
+    #pragma omp parallel
+    {
+        const int threadIdx = omp_get_thread_num();
+
+        int xStart, xEnd;
+        getThreadRange(width, THREAD_RANGE_ALIGN, threadIdx, omp_get_num_threads(), &xStart, &xEnd);
 
-            int insertOffsetX = -(x > seamX1);
-            int idx = getPixelIdx(x + insertOffsetX, y, data->width);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            unsigned int* seamRow = getSeamRow(data->imgSeam, y, data->stride);
+            if (threadIdx == 0)
+            {
+                if (y > 0)
+                {
+                    paddedRingFillRow(&ring, energyImg, data->stride, max(y - 2, 0), y - 2);
+                }
+                seamRowSetGuards(seamRow, width);
+            }
 
-            // Should recalculate.
-            int difX0 = abs(x - seamX0);
-            int difX1 = abs(x - seamX1);
-            int difX2 = abs(x - seamX2);
-            bool shouldRecalculate = difX0 <= 1 || difX1 <= 1 || difX2 <= 1;
+            PaddedImage view = paddedRingView(&ring, y, xStart, xEnd);
+            ENERGY_KERNEL(energyRow)(&view, &energyRow[xStart], 0);
 
-            // Recalculate and/or insert.
-            if (shouldRecalculate)
+            if (y == height - 1)
             {
-                int newX, newY;
-                getPixelPos(idx, data->width, &newX, &newY);
-                imgEnergyNew[idx] = calculatePixelEnergy(data->img, newX, newY, data->width, data->height, data->channelCount);
+                seamRowCopyEnergy(seamRow, energyRow, xStart, xEnd);
             }
             else
             {
-                imgEnergyNew[idx] = data->imgEnergy[getPixelIdx(x, y, oldWidth)];
+                ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, y + 1, data->stride), energyRow, seamRow, xStart, xEnd);
             }
+            #pragma omp barrier
         }
     }
 
-    free(data->imgEnergy);
-
-    data->imgEnergy = imgEnergyNew;
+    paddedImageFree(&ring);
+    free(energyRow);
 }
 
-/// @brief Calculate the cumulative energy of the image from the bottom to the top
-void seamIdentification(ImageProcessData* data)
+/// @brief Compute the cells of a trapezoid row by row (t counts rows from the bottom, the left and right
+/// edge move by dx0 and dx1 columns per row)
+static inline void trapezoidBase(ImageProcessData* data, int t0, int t1, int x0, int dx0, int x1, int dx1)
 {
-    // Free if already allocated
-    if (data->imgSeam != NULL)
+    for (int t = t0; t < t1; t++)
     {
-        free(data->imgSeam);
+        int y = data->height - 1 - t;
+        ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, y + 1, data->stride),
+                             &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                             getSeamRow(data->imgSeam, y, data->stride),
+                             x0 + dx0 * (t - t0), x1 + dx1 * (t - t0));
     }
+}
 
-    // Allocate space for seam and calculate cumulative energy for each pixel
-    data->imgSeam = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
+/// @brief Recursively decompose a trapezoid of the (row, column) DP space (Frigo-Strumpen style)
+static void trapezoidWalk(ImageProcessData* data, int t0, int t1, int x0, int dx0, int x1, int dx1)
+{
+    const int dt = t1 - t0;
+    const int bottomWidth = x1 - x0;
+    const int topWidth = bottomWidth + (dx1 - dx0) * dt;
+    const int cellCount = (bottomWidth + topWidth) * dt / 2;
 
-    // Fill bottom row with energy values
-    #pragma omp parallel
-    for (int x = 0; x < data->width; x++)
+    if (dt == 1 || cellCount <= TRAPEZOID_BASE_CELLS)
     {
-        data->imgSeam[getPixelIdx(x, data->height - 1, data->width)] = getEnergyPixelE(data->imgEnergy, x, data->height - 1, data->width, data->height);
+        trapezoidBase(data, t0, t1, x0, dx0, x1, dx1);
     }
-
-    /// Parallel:
-    // - each row has to be calculated before starting the next row, we can only parallelize calc of a row
-    for (int y = data->height - 2; y >= 0; y--)
+    else if (max(bottomWidth, topWidth) >= 4 * dt && bottomWidth >= topWidth)
     {
-        #pragma omp parallel for
-        for (int x = 0; x < data->width; x++)
-        {
-            unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, x - 1, y + 1, data->width, data->height);
-            unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, x    , y + 1, data->width, data->height);
-            unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, x + 1, y + 1, data->width, data->height);
+        // Space cut, wide bottom: upright triangle in the middle first, then both sides (they lean on it)
+        int xa = (x0 + x1) / 2 - dt;
+        int xb = xa + 2 * dt;
+        trapezoidWalk(data, t0, t1, xa, 1, xb, -1);
+
+        #pragma omp task if(cellCount > TRAPEZOID_TASK_CELLS)
+        trapezoidWalk(data, t0, t1, x0, dx0, xa, 1);
+        trapezoidWalk(data, t0, t1, xb, -1, x1, dx1);
+        #pragma omp taskwait
+    }
+    else if (max(bottomWidth, topWidth) >= 4 * dt)
+    {
+        // Space cut, wide top: both sides first (they lean away from each other), then the inverted triangle between them
+        int lo = x0 + (1 + dx0) * dt;
+        int hi = x1 - (1 - dx1) * dt;
+        int xm = (lo + hi) / 2;
 
-            unsigned int curEnergy = getEnergyPixelE(data->imgEnergy, x, y, data->width, data->height);
-            unsigned int minEnergy = min(leftEnergy, min(centerEnergy, rightEnergy));
+        #pragma omp task if(cellCount > TRAPEZOID_TASK_CELLS)
+        trapezoidWalk(data, t0, t1, x0, dx0, xm, -1);
+        trapezoidWalk(data, t0, t1, xm, 1, x1, dx1);
+        #pragma omp taskwait
 
-            data->imgSeam[getPixelIdx(x, y, data->width)] = curEnergy + minEnergy;
-        }
+        trapezoidWalk(data, t0, t1, xm, -1, xm, 1);
+    }
+    else
+    {
+        // Time cut: bottom half first, then the top half
+        int s = dt / 2;
+        trapezoidWalk(data, t0, t0 + s, x0, dx0, x1, dx1);
+        trapezoidWalk(data, t0 + s, t1, x0 + dx0 * s, dx0, x1 + dx1 * s, dx1);
     }
 }
 
-/// @brief Annotate the seam in the image (with SEAM value)
-void seamAnnotate(ImageProcessData* data)
+/// @brief Calculate the cumulative energy of the image with a cache-oblivious recursive trapezoid decomposition
+void trapezoidSeamIdentification(ImageProcessData* data)
 {
-    // Allocate memory for seam path
-    if (data->seamPath != NULL)
+    // Reuse the seam plane and fill the bottom row with energy values
+    seamPlanePrepare(data);
+
+    /// Parallel:
+    // - the DP space (t = rows from the bottom, x = columns) is cut recursively into trapezoids whose edges have
+    //   slope -1, 0 or +1 (a cell only depends on the 3 cells below it), so every sub-trapezoid fits into some cache
+    //   level without knowing the cache sizes
+    // - space cuts produce two trapezoids that don't depend on each other, they run as tasks
+    // - each cell is still computed once with the same DP row kernel, the result equals seamIdentification exactly
+    if (data->height > 1)
     {
-        free(data->seamPath);
+        #pragma omp parallel
+        #pragma omp single
+        trapezoidWalk(data, 1, data->height, 0, 0, data->width, 0);
     }
-    data->seamPath = (int *) malloc(sizeof(int) * data->height);
+}
 
-    // Find the minimum energy in the top row
-    int curX = 0;
-    for (int x = 1; x < data->width; x++)
+/// @brief Update the cumulative energy after the seam was removed, only the cells whose inputs changed are recalculated
+void incrementalSeamIdentification(ImageProcessData* data)
+{
+    // Nothing to update before the first seam was found
+    if (data->imgSeam == NULL || data->seamPath == NULL)
     {
-        if (data->imgSeam[getPixelIdx(x, 0, data->width)] < data->imgSeam[getPixelIdx(curX, 0, data->width)])
+        if (data->imgEnergy != NULL)
         {
-            curX = x;
+            seamIdentification(data);
+        }
+        else
+        {
+            streamingSeamIdentification(data);
         }
+        return;
     }
 
-    // Set SEAM
-    data->seamPath[0] = curX;
+    const int width = data->width;
+    const int height = data->height;
 
-    for (int y = 0; y < data->height - 1; y++)
+    // Compact every row like the energy (the old cumulative values keep their meaning for the shifted pixels)
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++)
     {
-        // Find the minimum energy in the next row
-        unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, curX - 1, y + 1, data->width, data->height);
-        unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, curX    , y + 1, data->width, data->height);
-        unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, curX + 1, y + 1, data->width, data->height);
+        unsigned int* seamRow = getSeamRow(data->imgSeam, y, data->stride);
+        seamCompactRow(seamRow, &data->seamPath[y], 1, width + 1, sizeof(unsigned int));
+        seamRowSetGuards(seamRow, width);
+    }
+
+    /// Parallel:
+    // - a cell of row y only changes if its energy changed, its three children map to other pixels (both only near
+    //   the seam of rows y - 1, y, y + 1) or one of its children changed (the dirty interval of row y + 1, one wider)
+    // - rows go bottom-up, the recalculated range of a row is cut down to the cells that really changed, so the dirty
+    //   interval stops growing as soon as the new values match the old ones
+    // - rows stay sequential, a row is only split between threads when its range is wide enough to pay the fork/join
+    // - with streaming energy only the seam window is calculated with the sobel operator, the other cells of the range
+    //   kept their energy, which is their old cumulative value minus the min of their old children (row y + 1 before
+    //   it was recalculated, the cells outside of its range didn't change)
+    unsigned int* seamRowsOld = seamPlaneAlloc(width, 2);
+    unsigned int* seamRowOld = getSeamRow(seamRowsOld, 0, width);
+    unsigned int* seamRowOldBelow = getSeamRow(seamRowsOld, 1, width);
+    EnergyValue* energyScratch = data->imgEnergy == NULL ? (EnergyValue *) malloc(sizeof(EnergyValue) * width) : NULL;
+    int oldBelowStart = 0;
+    int oldBelowEnd = 0;
+    int dirtyStart = 0;
+    int dirtyEnd = 0;
+    for (int y = height - 1; y >= 0; y--)
+    {
+        int seamX0 = y > 0 ? data->seamPath[y - 1] : data->seamPath[y];
+        int seamX1 = data->seamPath[y];
+        int seamX2 = y < height - 1 ? data->seamPath[y + 1] : data->seamPath[y];
 
-        // Select next X
-        if (leftEnergy < centerEnergy && leftEnergy < rightEnergy)
+        int xStart = min(min(seamX0, seamX1), seamX2) - 2;
+        int xEnd = max(max(seamX0, seamX1), seamX2) + 2;
+        if (dirtyStart < dirtyEnd)
         {
-            curX = curX - 1;
+            xStart = min(xStart, dirtyStart - 1);
+            xEnd = max(xEnd, dirtyEnd + 1);
         }
-        else if (rightEnergy < centerEnergy && rightEnergy < leftEnergy)
+        xStart = max(xStart, 0);
+        xEnd = min(xEnd, width);
+
+        unsigned int* seamRow = getSeamRow(data->imgSeam, y, data->stride);
+        memcpy(&seamRowOld[xStart], &seamRow[xStart], sizeof(unsigned int) * (xEnd - xStart));
+
+        const EnergyValue* energyRow;
+        if (data->imgEnergy != NULL)
         {
-            curX = curX + 1;
+            energyRow = &data->imgEnergy[getPixelIdx(0, y, data->stride)];
         }
+        else
+        {
+            if (y == height - 1)
+            {
+                for (int x = xStart; x < xEnd; x++)
+                {
+                    energyScratch[x] = seamRowOld[x];
+                }
+            }
+            else
+            {
+                // Complete the old children around the range with the cells of row y + 1 that weren't recalculated
+                const unsigned int* seamRowBelow = getSeamRow(data->imgSeam, y + 1, data->stride);
+                int childStart = max(xStart - 1, 0);
+                int childEnd = min(xEnd + 1, width);
+                int gapEnd = min(oldBelowStart, childEnd);
+                int gapStart = max(oldBelowEnd, childStart);
+                if (childStart < gapEnd)
+                {
+                    memcpy(&seamRowOldBelow[childStart], &seamRowBelow[childStart], sizeof(unsigned int) * (gapEnd - childStart));
+                }
+                if (gapStart < childEnd)
+                {
+                    memcpy(&seamRowOldBelow[gapStart], &seamRowBelow[gapStart], sizeof(unsigned int) * (childEnd - gapStart));
+                }
 
-        // Set SEAM
-        data->seamPath[y + 1] = curX;
-    }
-}
+                for (int x = xStart; x < xEnd; x++)
+                {
+                    energyScratch[x] = seamRowOld[x] - min(min(seamRowOldBelow[x - 1], seamRowOldBelow[x]), seamRowOldBelow[x + 1]);
+                }
+            }
 
-/// @brief Remove the seam from the image
-void seamRemove(ImageProcessData* processData)
-{
-    // Allocate space for new image
-    unsigned int newWidth = processData->width - 1;
-    unsigned int pixelCount = newWidth * processData->height;
-    unsigned char* image = (unsigned char *) malloc(sizeof(unsigned char) * pixelCount * processData->channelCount);
+            int windowStart = max(min(min(seamX0, seamX1), seamX2) - 2, xStart);
+            int windowEnd = min(max(max(seamX0, seamX1), seamX2) + 2, xEnd);
+            for (int x = windowStart; x < windowEnd; x++)
+            {
+                energyScratch[x] = calculateDataPixelEnergy(data, x, y);
+            }
+            energyRow = energyScratch;
+        }
 
-    // Copy image data without seam
-    /// Parallel:
-    // - standard for parallel, as the copying of whole lines is nicely devided between threads
-    #pragma omp parallel for
-    for (int y = 0; y < processData->height; y++)
-    {
-        int seanPassed = false;  // Did we pass the sean?
-        for (int x = 0; x < processData->width; x++)
+        if (y == height - 1)
+        {
+            seamRowCopyEnergy(seamRow, energyRow, xStart, xEnd);
+        }
+        else
         {
-            if (!isSeam(processData, x, y))
+            const unsigned int* seamRowBelow = getSeamRow(data->imgSeam, y + 1, data->stride);
+
+            // (an if() clause would still open a region per row, that alone costs more than a narrow range)
+            if (xEnd - xStart <= INCREMENTAL_PARALLEL_CELLS)
+            {
+                ENERGY_KERNEL(dpRow)(seamRowBelow, energyRow, seamRow, xStart, xEnd);
+            }
+            else
             {
-                unsigned int pixelIdxC = getPixelIdxC(x, y, processData->width, processData->channelCount);
-                for (int channel = 0; channel < processData->channelCount; channel++)
+                #pragma omp parallel
                 {
-                    unsigned int pixelPos = getPixelIdxC(x - seanPassed, y, newWidth, processData->channelCount);
-                    image[pixelPos + channel] = processData->img[pixelIdxC + channel];
+                    int rangeStart, rangeEnd;
+                    getThreadRange(xEnd - xStart, THREAD_RANGE_ALIGN, omp_get_thread_num(), omp_get_num_threads(), &rangeStart, &rangeEnd);
+                    ENERGY_KERNEL(dpRow)(seamRowBelow, energyRow, seamRow, xStart + rangeStart, xStart + rangeEnd);
                 }
             }
-            else
-                seanPassed = true;
         }
-    }
 
-    // Free old image and set new image
-    free(processData->img);
+        // Cut the range down to the cells that changed
+        dirtyStart = xStart;
+        dirtyEnd = xEnd;
+        while (dirtyStart < dirtyEnd && seamRow[dirtyStart] == seamRowOld[dirtyStart]) dirtyStart++;
+        while (dirtyEnd > dirtyStart && seamRow[dirtyEnd - 1] == seamRowOld[dirtyEnd - 1]) dirtyEnd--;
+
+        // The old values of this row are the old children of the next one
+        unsigned int* swap = seamRowOldBelow;
+        seamRowOldBelow = seamRowOld;
+        seamRowOld = swap;
+        oldBelowStart = xStart;
+        oldBelowEnd = xEnd;
+    }
 
-    // Update process data
-    processData->img = image;
-    processData->width = processData->width - 1;
-    processData->height = processData->height;
-    processData->channelCount = processData->channelCount;
+    free(seamRowsOld);
+    free(energyScratch);
 }
 
-#ifdef RENDER_LOADING_BAR_WIDTH
-/// @brief Update the loading bar
-void updatePrintLoadingBar(int progress, int total)
+/// @brief Calculate column j of the transfer matrix of rows [y0, y1): the cheapest path from (x, y0) to (j, y1) summing
+/// the energy of rows y0 to y1 - 1, for every x within band of j (rowA and rowB are width wide scratch rows)
+static inline void minPlusTransferColumn(ImageProcessData* data, int y0, int y1, int j, int band, unsigned int* transfer, unsigned int* rowA, unsigned int* rowB)
 {
-    static int lastProgress = -1;
-    if (lastProgress != -1) {
-        printf("\033[F"); // Move cursor up one line
+    const int width = data->width;
+    unsigned int* rowBelow = rowA;
+    unsigned int* row = rowB;
+
+    // Row y1 - 1 steps straight onto j
+    int xStart = max(j - 1, 0);
+    int xEnd = min(j + 1, width - 1);
+    const EnergyValue* energyRow = &data->imgEnergy[getPixelIdx(0, y1 - 1, data->stride)];
+    for (int x = xStart; x <= xEnd; x++)
+    {
+        rowBelow[x] = energyRow[x];
     }
 
-    int percent = (progress * 100) / total;
-    int filled = (progress * RENDER_LOADING_BAR_WIDTH) / total;
+    // Every row above reaches one column further, neighbours outside the reached range are infinite
+    for (int y = y1 - 2; y >= y0; y--)
+    {
+        int xStartAbove = max(xStart - 1, 0);
+        int xEndAbove = min(xEnd + 1, width - 1);
+        energyRow = &data->imgEnergy[getPixelIdx(0, y, data->stride)];
+        for (int x = xStartAbove; x <= xEndAbove; x++)
+        {
+            unsigned int minEnergy = UINT_MAX;
+            for (int childX = max(x - 1, xStart); childX <= min(x + 1, xEnd); childX++)
+            {
+                minEnergy = min(minEnergy, rowBelow[childX]);
+            }
+            row[x] = energyRow[x] + minEnergy;
+        }
 
-    printf("[");  // Carriage return to overwrite line
-    for (int i = 0; i < filled; i++) printf("=");
-    for (int i = filled; i < RENDER_LOADING_BAR_WIDTH; i++) printf(" ");
-    printf("] %d%%\n", percent);
+        unsigned int* swap = rowBelow;
+        rowBelow = row;
+        row = swap;
+        xStart = xStartAbove;
+        xEnd = xEndAbove;
+    }
 
-    fflush(stdout);
-    lastProgress = progress;
+    // Row x of the matrix keeps the band j - x in [-band, band]
+    for (int x = xStart; x <= xEnd; x++)
+    {
+        transfer[x * (2 * band + 1) + j - x + band] = rowBelow[x];
+    }
 }
-#endif
 
-int main(int argc, char *args[])
+/// @brief Calculate the cumulative energy with the rows split into one block per thread, the blocks are joined through
+/// their min-plus transfer matrices instead of waiting for the block below
+/// (the matrices cost about min(rows per block, width) times the work of the plain DP, so this only pays off for
+/// narrow, tall images where a row is too short to split between the threads)
+void minPlusSeamIdentification(ImageProcessData* data)
 {
-    // Read arguments
-    if (argc != 4)
+    // Reuse the seam plane and fill the bottom row with energy values
+    seamPlanePrepare(data);
+
+    const int width = data->width;
+    const int rowCount = data->height - 1;  // Rows above the bottom row
+    const int blockCount = max(min(omp_get_max_threads(), rowCount), 1);
+
+    // Block b holds rows [blockStart[b], blockStart[b + 1]), its transfer matrix is width x (2 * band + 1), where the
+    // band is the number of rows (a path moves at most one column per row), at most width - 1
+    int* blockStart = (int *) malloc(sizeof(int) * (blockCount + 1));
+    size_t* transferOffset = (size_t *) malloc(sizeof(size_t) * (blockCount + 1));
+    transferOffset[0] = 0;
+    for (int blockIdx = 0; blockIdx <= blockCount; blockIdx++)
     {
-        printf("Error: Invalid amount of arguments. [%d]\n", argc);
-        exit(EXIT_FAILURE);
+        blockStart[blockIdx] = (int) ((long long) blockIdx * rowCount / blockCount);
+    }
+    for (int blockIdx = 0; blockIdx < blockCount; blockIdx++)
+    {
+        int band = min(blockStart[blockIdx + 1] - blockStart[blockIdx], width - 1);
+        bool isBottomBlock = blockIdx == blockCount - 1;
+        transferOffset[blockIdx + 1] = transferOffset[blockIdx] + (isBottomBlock ? 0 : (size_t) width * (2 * band + 1));
     }
-    printf("Arguments: imageInPath=%s, imageOutPath=%s, seamCount=%s\n", args[1], args[2], args[3]);
 
-    // Parse arguments /////////////////////////////////////////////////////////////////////
-    char *imageInPath = args[1];
-    char *imageOutPath = args[2];
-    int seamCount = atoi(args[3]);
-    int outputHeight; // = atoi(args[4]); // Height stays the same
+    // Allocate once (the first image is the widest)
+    if (data->seamTransfers == NULL)
+    {
+        data->seamTransfers = (unsigned int *) malloc(sizeof(unsigned int) * max(transferOffset[blockCount], (size_t) 1));
+    }
 
-    // Setup processing data struct //////////////////////////////////////////////////////
-    ImageProcessData processData;
-    processData.img = NULL;
-    processData.imgEnergy = NULL;
-    processData.imgSeam = NULL;
-    processData.seamPath = NULL;
+    /// Parallel:
+    // - the bottom block has a known input (the bottom row), it is calculated directly by one thread
+    // - the other threads calculate the transfer matrices of the blocks above, one column (target pixel) at a time,
+    //   every column is a small DP over the block that only grows one pixel per row (min-plus product of the bands)
+    // - the top rows of the blocks are then joined bottom-up (the scan of the min-plus products), one matrix-vector
+    //   product per block, each split between the threads by columns
+    // - with the top row of the block below known, every block calculates its interior rows on its own
+    #pragma omp parallel
+    {
+        unsigned int* rowA = (unsigned int *) malloc(sizeof(unsigned int) * width);
+        unsigned int* rowB = (unsigned int *) malloc(sizeof(unsigned int) * width);
 
-    // Load image //////////////////////////////////////////////////////////////////////////
+        #pragma omp single nowait
+        {
+            for (int y = data->height - 2; y >= blockStart[blockCount - 1]; y--)
+            {
+                ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, y + 1, data->stride),
+                                     &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                     getSeamRow(data->imgSeam, y, data->stride),
+                                     0, width);
+            }
+        }
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int columnIdx = 0; columnIdx < (blockCount - 1) * width; columnIdx++)
+        {
+            int blockIdx = columnIdx / width;
+            int band = min(blockStart[blockIdx + 1] - blockStart[blockIdx], width - 1);
+            minPlusTransferColumn(data, blockStart[blockIdx], blockStart[blockIdx + 1], columnIdx % width, band,
+                                  &data->seamTransfers[transferOffset[blockIdx]], rowA, rowB);
+        }
+
+        for (int blockIdx = blockCount - 2; blockIdx >= 0; blockIdx--)
+        {
+            int band = min(blockStart[blockIdx + 1] - blockStart[blockIdx], width - 1);
+            const unsigned int* transfer = &data->seamTransfers[transferOffset[blockIdx]];
+            const unsigned int* seamRowBelow = getSeamRow(data->imgSeam, blockStart[blockIdx + 1], data->stride);
+            unsigned int* seamRow = getSeamRow(data->imgSeam, blockStart[blockIdx], data->stride);
+
+            #pragma omp for
+            for (int x = 0; x < width; x++)
+            {
+                const unsigned int* transferRow = &transfer[x * (2 * band + 1) - x + band];  // Indexed by j
+                unsigned int minEnergy = UINT_MAX;
+                for (int j = max(x - band, 0); j <= min(x + band, width - 1); j++)
+                {
+                    minEnergy = min(minEnergy, transferRow[j] + seamRowBelow[j]);
+                }
+                seamRow[x] = minEnergy;
+            }
+        }
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int blockIdx = 0; blockIdx < blockCount - 1; blockIdx++)
+        {
+            for (int y = blockStart[blockIdx + 1] - 1; y > blockStart[blockIdx]; y--)
+            {
+                ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, y + 1, data->stride),
+                                     &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                     getSeamRow(data->imgSeam, y, data->stride),
+                                     0, width);
+            }
+        }
+
+        free(rowA);
+        free(rowB);
+    }
+
+    free(blockStart);
+    free(transferOffset);
+}
+
+/// @brief Calculate the cumulative energy from the bottom up to the middle row and from the top down to the row above
+/// it at the same time (rows [0, height / 2) hold the top-down energy, rows [height / 2, height) the bottom-up one)
+void bidirectionalSeamIdentification(ImageProcessData* data)
+{
+    // Reuse the seam plane and fill the bottom row with energy values
+    seamPlanePrepare(data);
+
+    const int width = data->width;
+    const int height = data->height;
+    const int meetY = height / 2;
+
+    // Fill top row with energy values (the row above the middle row is the last top-down one)
+    if (meetY > 0)
+    {
+        seamRowCopyEnergy(getSeamRow(data->imgSeam, 0, data->stride), &data->imgEnergy[getPixelIdx(0, 0, data->stride)], 0, width);
+    }
+
+    /// Parallel:
+    // - the first half of the team runs the top-down DP, the second half the bottom-up one, each group splits its row
+    //   by columns like seamIdentification (a single thread runs both)
+    // - the dpRow kernel doesn't care about the direction, the top-down rows pass the row above as their input
+    // - both directions advance one row per step, so one barrier per step serves both groups and the chain is
+    //   max(meetY, height - meetY) - 1 steps long instead of height - 1
+    #pragma omp parallel
+    {
+        const int threadIdx = omp_get_thread_num();
+        const int threadCount = omp_get_num_threads();
+        const int topThreadCount = max(threadCount / 2, 1);
+        const bool runsTop = threadCount == 1 || threadIdx < topThreadCount;
+        const bool runsBottom = threadCount == 1 || threadIdx >= topThreadCount;
+
+        int xStart, xEnd;
+        if (threadCount == 1)
+        {
+            getThreadRange(width, THREAD_RANGE_ALIGN, 0, 1, &xStart, &xEnd);
+        }
+        else if (runsTop)
+        {
+            getThreadRange(width, THREAD_RANGE_ALIGN, threadIdx, topThreadCount, &xStart, &xEnd);
+        }
+        else
+        {
+            getThreadRange(width, THREAD_RANGE_ALIGN, threadIdx - topThreadCount, threadCount - topThreadCount, &xStart, &xEnd);
+        }
+
+        const int stepCount = max(meetY - 1, height - 1 - meetY);
+        for (int step = 0; step < stepCount; step++)
+        {
+            int yTop = 1 + step;
+            int yBottom = height - 2 - step;
+
+            if (runsTop && yTop < meetY)
+            {
+                ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, yTop - 1, data->stride),
+                                     &data->imgEnergy[getPixelIdx(0, yTop, data->stride)],
+                                     getSeamRow(data->imgSeam, yTop, data->stride),
+                                     xStart, xEnd);
+            }
+            if (runsBottom && yBottom >= meetY)
+            {
+                ENERGY_KERNEL(dpRow)(getSeamRow(data->imgSeam, yBottom + 1, data->stride),
+                                     &data->imgEnergy[getPixelIdx(0, yBottom, data->stride)],
+                                     getSeamRow(data->imgSeam, yBottom, data->stride),
+                                     xStart, xEnd);
+            }
+            #pragma omp barrier
+        }
+    }
+}
+
+/// @brief Follow the min of the cumulative energy from x to the row below (left/right only when strictly smaller than
+/// both other ones, guard columns hold INT_MAX at the image edges)
+static inline int seamStep(const unsigned int* seamRowBelow, int curX)
+{
+    unsigned int leftEnergy =   seamRowBelow[curX - 1];
+    unsigned int centerEnergy = seamRowBelow[curX    ];
+    unsigned int rightEnergy =  seamRowBelow[curX + 1];
+
+    if (leftEnergy < centerEnergy && leftEnergy < rightEnergy)
+    {
+        return curX - 1;
+    }
+    else if (rightEnergy < centerEnergy && rightEnergy < leftEnergy)
+    {
+        return curX + 1;
+    }
+    return curX;
+}
+
+/// @brief Annotate the seam in the image (with SEAM value)
+void seamAnnotate(ImageProcessData* data)
+{
+    // Allocate memory for seam path (once, the height never changes)
+    if (data->seamPath == NULL)
+    {
+        data->seamPath = (int *) malloc(sizeof(int) * data->height);
+    }
+
+    // Find the minimum energy in the top row
+    const unsigned int* seamRowTop = getSeamRow(data->imgSeam, 0, data->stride);
+    int curX = 0;
+    for (int x = 1; x < data->width; x++)
+    {
+        if (seamRowTop[x] < seamRowTop[curX])
+        {
+            curX = x;
+        }
+    }
+
+    // Set SEAM
+    data->seamCount = 1;
+    data->seamPath[0] = curX;
+
+    for (int y = 0; y < data->height - 1; y++)
+    {
+        // Find the minimum energy in the next row
+        curX = seamStep(getSeamRow(data->imgSeam, y + 1, data->stride), curX);
+
+        // Set SEAM
+        data->seamPath[y + 1] = curX;
+    }
+}
+
+/// @brief Calculate the cumulative energy from the bottom to the top keeping only two rows, the direction of every
+/// pixel's min is stored in the packed direction map
+void rollingSeamIdentification(ImageProcessData* data)
+{
+    // Allocate once for the original width (2 rows of cumulative energy, 2 bits per pixel of directions)
+    if (data->imgSeam == NULL)
+    {
+        data->imgSeam = seamPlaneAlloc(data->stride, 2);
+        data->seamDirections = (unsigned char *) malloc(sizeof(unsigned char) * getDirectionStride(data->stride) * data->height);
+    }
+
+    for (int y = 0; y < 2; y++)
+    {
+        seamRowSetGuards(getSeamRow(data->imgSeam, y, data->stride), data->width);
+    }
+
+    // Fill bottom row with energy values (row y lives in buffer y & 1)
+    seamRowCopyEnergy(getSeamRow(data->imgSeam, (data->height - 1) & 1, data->stride),
+                      &data->imgEnergy[getPixelIdx(0, data->height - 1, data->stride)], 0, data->width);
+
+    /// Parallel:
+    // - same split as seamIdentification (one column range per thread), but one parallel region with a barrier per
+    //   row, as a row now overwrites the buffer that was read two rows earlier
+    // - the ranges are multiples of 16 columns, so no two threads share a byte of the direction map
+    #pragma omp parallel
+    {
+        int xStart, xEnd;
+        getThreadRange(data->width, THREAD_RANGE_ALIGN, omp_get_thread_num(), omp_get_num_threads(), &xStart, &xEnd);
+
+        for (int y = data->height - 2; y >= 0; y--)
+        {
+            ENERGY_KERNEL(dpRowDirections)(getSeamRow(data->imgSeam, (y + 1) & 1, data->stride),
+                                           &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                           getSeamRow(data->imgSeam, y & 1, data->stride),
+                                           getDirectionRow(data->seamDirections, y, data->stride),
+                                           xStart, xEnd);
+            #pragma omp barrier
+        }
+    }
+}
+
+/// @brief Calculate the cumulative forward energy from the bottom to the top (rolling rows and direction map like
+/// rollingSeamIdentification), the costs of a row are calculated from a ring of padded image rows just before its DP row
+void forwardSeamIdentification(ImageProcessData* data)
+{
+    const int width = data->width;
+    const int height = data->height;
+
+    // Allocate once for the original width (2 rows of cumulative energy, 2 bits per pixel of directions)
+    if (data->imgSeam == NULL)
+    {
+        data->imgSeam = seamPlaneAlloc(data->stride, 2);
+        data->seamDirections = (unsigned char *) malloc(sizeof(unsigned char) * getDirectionStride(data->stride) * height);
+    }
+
+    for (int y = 0; y < 2; y++)
+    {
+        seamRowSetGuards(getSeamRow(data->imgSeam, y, data->stride), width);
+    }
+
+    int energyChannelCount;
+    const unsigned char* energyImg = getEnergyImage(data, &energyChannelCount);
+
+    PaddedImage ring;
+    paddedRingAlloc(&ring, width, energyChannelCount);
+    unsigned int* costs = (unsigned int *) malloc(sizeof(unsigned int) * 3 * width);
+    unsigned int* costUp = costs;
+    unsigned int* costLeft = &costs[width];
+    unsigned int* costRight = &costs[2 * width];
+
+    // Same ring schedule as streamingSeamIdentification (the costs of row y read rows y and y + 1)
+    paddedRingFillRow(&ring, energyImg, data->stride, height - 1, height);
+    paddedRingFillRow(&ring, energyImg, data->stride, height - 1, height - 1);
+    paddedRingFillRow(&ring, energyImg, data->stride, max(height - 2, 0), height - 2);
+
+    /// Parallel:
+    // - one parallel region, one barrier per row, every thread calculates the costs of its columns of the row and runs
+    //   the DP on them right away, thread 0 copies the image row two rows up into the ring
+    // - the ranges are multiples of 16 columns, so no two threads share a byte of the direction map
+    #pragma omp parallel
+    {
+        const int threadIdx = omp_get_thread_num();
+
+        int xStart, xEnd;
+        getThreadRange(width, THREAD_RANGE_ALIGN, threadIdx, omp_get_num_threads(), &xStart, &xEnd);
+
+        for (int y = height - 1; y >= 0; y--)
+        {
+            if (threadIdx == 0 && y > 0)
+            {
+                paddedRingFillRow(&ring, energyImg, data->stride, max(y - 2, 0), y - 2);
+            }
+
+            PaddedImage view = paddedRingView(&ring, y, xStart, xEnd);
+            seamKernels.forwardCostRow(&view, &costUp[xStart], &costLeft[xStart], &costRight[xStart], 0);
+
+            // The bottom row has no row below, removing a pixel there only joins its left and right neighbour
+            unsigned int* seamRow = getSeamRow(data->imgSeam, y & 1, data->stride);
+            if (y == height - 1)
+            {
+                memcpy(&seamRow[xStart], &costUp[xStart], sizeof(unsigned int) * (xEnd - xStart));
+            }
+            else
+            {
+                seamKernels.dpRowForward(getSeamRow(data->imgSeam, (y + 1) & 1, data->stride), costUp, costLeft, costRight,
+                                         seamRow, getDirectionRow(data->seamDirections, y, data->stride), xStart, xEnd);
+            }
+            #pragma omp barrier
+        }
+    }
+
+    paddedImageFree(&ring);
+    free(costs);
+}
+
+/// @brief Annotate the seam by following the direction map from the minimum of the top row
+void rollingSeamAnnotate(ImageProcessData* data)
+{
+    // Allocate memory for seam path (once, the height never changes)
+    if (data->seamPath == NULL)
+    {
+        data->seamPath = (int *) malloc(sizeof(int) * data->height);
+    }
+
+    // Find the minimum energy in the top row (row 0 is in buffer 0)
+    const unsigned int* seamRowTop = getSeamRow(data->imgSeam, 0, data->stride);
+    int curX = 0;
+    for (int x = 1; x < data->width; x++)
+    {
+        if (seamRowTop[x] < seamRowTop[curX])
+        {
+            curX = x;
+        }
+    }
+
+    // Set SEAM
+    data->seamCount = 1;
+    data->seamPath[0] = curX;
+
+    for (int y = 0; y < data->height - 1; y++)
+    {
+        curX += getDirection(getDirectionRow(data->seamDirections, y, data->stride), curX) - 1;
+        data->seamPath[y + 1] = curX;
+    }
+}
+
+/// @brief Step from x to the cheapest of its three neighbours in the next row (ties prefer the center, then left),
+/// unlike seamStep this always finds the minimum, so the seam costs exactly what the two halves promised at the middle
+static inline int seamStepMin(const unsigned int* seamRowNext, int curX)
+{
+    int nextX = curX;
+    if (seamRowNext[curX - 1] < seamRowNext[nextX]) nextX = curX - 1;
+    if (seamRowNext[curX + 1] < seamRowNext[nextX]) nextX = curX + 1;
+    return nextX;
+}
+
+/// @brief Annotate the seam by joining the two halves of the bidirectional DP at the middle row and following both
+/// halves away from it (a cheapest seam, but not always the one seamAnnotate picks: its tie rule needs the bottom-up
+/// energy of the top rows, which this engine doesn't calculate, so ties go to the leftmost crossing and then to the
+/// center, then left)
+void bidirectionalSeamAnnotate(ImageProcessData* data)
+{
+    // Allocate memory for seam path (once, the height never changes)
+    if (data->seamPath == NULL)
+    {
+        data->seamPath = (int *) malloc(sizeof(int) * data->height);
+    }
+
+    const int meetY = data->height / 2;
+    data->seamCount = 1;
+
+    // A single row has no top-down half, the seam is the min of the bottom-up row
+    if (meetY == 0)
+    {
+        seamAnnotate(data);
+        return;
+    }
+
+    // Find the cheapest crossing between the row above the middle row and the middle row (sum of both halves)
+    const unsigned int* seamRowAbove = getSeamRow(data->imgSeam, meetY - 1, data->stride);
+    const unsigned int* seamRowMeet = getSeamRow(data->imgSeam, meetY, data->stride);
+    int meetX = 0;
+    unsigned int meetEnergy = UINT_MAX;
+    for (int x = 0; x < data->width; x++)
+    {
+        unsigned int energy = seamRowAbove[x] + seamRowMeet[seamStepMin(seamRowMeet, x)];
+        if (energy < meetEnergy)
+        {
+            meetEnergy = energy;
+            meetX = x;
+        }
+    }
+
+    // Set SEAM
+    data->seamPath[meetY - 1] = meetX;
+
+    /// Parallel:
+    // - the two halves only read their own rows of the plane and write their own rows of the path
+    // - the top-down rows hold the cheapest path up to the top, so the same step walks them upwards
+    #pragma omp parallel sections num_threads(2)
+    {
+        #pragma omp section
+        {
+            int curX = meetX;
+            for (int y = meetY - 1; y > 0; y--)
+            {
+                curX = seamStepMin(getSeamRow(data->imgSeam, y - 1, data->stride), curX);
+                data->seamPath[y - 1] = curX;
+            }
+        }
+        #pragma omp section
+        {
+            int curX = meetX;
+            for (int y = meetY - 1; y < data->height - 1; y++)
+            {
+                curX = seamStepMin(getSeamRow(data->imgSeam, y + 1, data->stride), curX);
+                data->seamPath[y + 1] = curX;
+            }
+        }
+    }
+}
+
+/// @brief Step from x to the row below like seamStep, but never onto a claimed pixel or diagonally across a claimed
+/// seam (ties prefer the center, then left, then right), returns -1 if every way down is blocked
+static inline int multiSeamStepMasked(const unsigned int* seamRowBelow, const unsigned char* claimedRow, const unsigned char* claimedRowBelow, int curX, int width)
+{
+    static const int stepOrder[3] = { 0, -1, 1 };
+
+    int nextX = -1;
+    for (int stepIdx = 0; stepIdx < 3; stepIdx++)
+    {
+        int x = curX + stepOrder[stepIdx];
+        if (x < 0 || x >= width || claimedRowBelow[x])
+        {
+            continue;
+        }
+        if (x != curX && claimedRow[x] && claimedRowBelow[curX])
+        {
+            continue;  // A claimed seam goes the other way between the two rows
+        }
+        if (nextX < 0 || seamRowBelow[x] < seamRowBelow[nextX])
+        {
+            nextX = x;
+        }
+    }
+
+    return nextX;
+}
+
+/// @brief Annotate up to seamsPerPass non-crossing seams, starting from the lowest entries of the top row of the
+/// cumulative energy plane
+void multiSeamAnnotate(ImageProcessData* data)
+{
+    const int width = data->width;
+    const int height = data->height;
+    const int candidateCount = data->seamsPerPass;  // Less than width, at most the seams that are left
+
+    // Allocate memory for seam paths (once, the first pass extracts the most seams)
+    if (data->seamPath == NULL)
+    {
+        data->seamPath = (int *) malloc(sizeof(int) * candidateCount * height);
+    }
+
+    // Find the candidateCount lowest energies in the top row (sorted, ties go to the lower x)
+    const unsigned int* seamRowTop = getSeamRow(data->imgSeam, 0, data->stride);
+    int* candidateX = (int *) malloc(sizeof(int) * candidateCount);
+    int foundCount = 0;
+    for (int x = 0; x < width; x++)
+    {
+        if (foundCount == candidateCount && seamRowTop[x] >= seamRowTop[candidateX[foundCount - 1]])
+        {
+            continue;
+        }
+
+        int insertIdx = foundCount < candidateCount ? foundCount++ : foundCount - 1;
+        while (insertIdx > 0 && seamRowTop[x] < seamRowTop[candidateX[insertIdx - 1]])
+        {
+            candidateX[insertIdx] = candidateX[insertIdx - 1];
+            insertIdx--;
+        }
+        candidateX[insertIdx] = x;
+    }
+
+    // Backtrack every candidate on its own
+    /// Parallel:
+    // - the backtracks only read the cumulative energy plane, one candidate per iteration
+    int* candidatePaths = (int *) malloc(sizeof(int) * candidateCount * height);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int candidateIdx = 0; candidateIdx < candidateCount; candidateIdx++)
+    {
+        int* path = &candidatePaths[candidateIdx * height];
+        path[0] = candidateX[candidateIdx];
+        for (int y = 0; y < height - 1; y++)
+        {
+            path[y + 1] = seamStep(getSeamRow(data->imgSeam, y + 1, data->stride), path[y]);
+        }
+    }
+
+    // Accept the candidates from the lowest energy up, a path that runs into a claimed pixel (backtracks of
+    // neighbouring minima usually merge) is rerouted around the claimed seams from there on or dropped if it is boxed in
+    unsigned char* claimed = (unsigned char *) calloc((size_t) width * height, sizeof(unsigned char));
+    int* acceptedIdx = (int *) malloc(sizeof(int) * candidateCount);
+    int acceptedCount = 0;
+    for (int candidateIdx = 0; candidateIdx < candidateCount; candidateIdx++)
+    {
+        int* path = &candidatePaths[candidateIdx * height];
+        bool rerouted = false;
+        bool blocked = false;
+        for (int y = 1; y < height && !blocked; y++)
+        {
+            const unsigned char* claimedRow = &claimed[(y - 1) * width];
+            const unsigned char* claimedRowBelow = &claimed[y * width];
+            int curX = path[y - 1];
+            int nextX = path[y];
+
+            if (rerouted || claimedRowBelow[nextX] || (nextX != curX && claimedRow[nextX] && claimedRowBelow[curX]))
+            {
+                nextX = multiSeamStepMasked(getSeamRow(data->imgSeam, y, data->stride), claimedRow, claimedRowBelow, curX, width);
+                blocked = nextX < 0;
+                rerouted = nextX != path[y];
+                path[y] = nextX;
+            }
+        }
+
+        if (!blocked)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                claimed[y * width + path[y]] = 1;
+            }
+            acceptedIdx[acceptedCount++] = candidateIdx;
+        }
+    }
+
+    // Sort the accepted seams by x (they don't cross, so the order is the same in every row)
+    for (int i = 1; i < acceptedCount; i++)
+    {
+        int candidateIdx = acceptedIdx[i];
+        int j = i;
+        while (j > 0 && candidateX[acceptedIdx[j - 1]] > candidateX[candidateIdx])
+        {
+            acceptedIdx[j] = acceptedIdx[j - 1];
+            j--;
+        }
+        acceptedIdx[j] = candidateIdx;
+    }
+
+    // Set SEAMS (the lowest candidate is never blocked, so there is at least one)
+    data->seamCount = acceptedCount;
+    for (int y = 0; y < height; y++)
+    {
+        for (int seamIdx = 0; seamIdx < acceptedCount; seamIdx++)
+        {
+            data->seamPath[y * acceptedCount + seamIdx] = candidatePaths[acceptedIdx[seamIdx] * height + y];
+        }
+    }
+
+    free(candidateX);
+    free(candidatePaths);
+    free(claimed);
+    free(acceptedIdx);
+}
+
+/// @brief Sum the per-channel energy of the seam pixels of row y before they are removed (width is the width before the
+/// removal, with a luminance plane the energy plane holds the luminance energy, forward energy has no energy plane, this
+/// keeps seamEnergy comparable to the per-channel result)
+static inline unsigned long long seamEnergyPerChannelRow(ImageProcessData* data, int y, int width)
+{
+    unsigned long long seamEnergy = 0;
+    for (int seamIdx = 0; seamIdx < data->seamCount; seamIdx++)
+    {
+        seamEnergy += calculatePixelEnergy(data->img, data->seamPath[y * data->seamCount + seamIdx], y,
+                                           width, data->height, data->stride, data->channelCount);
+    }
+
+    return seamEnergy;
+}
+
+/// @brief Sum the per-channel energy of the seam pixels of every row (see seamEnergyPerChannelRow)
+static inline unsigned long long seamEnergyPerChannel(ImageProcessData* data)
+{
+    unsigned long long seamEnergy = 0;
+    #pragma omp parallel for reduction(+:seamEnergy)
+    for (int y = 0; y < data->height; y++)
+    {
+        seamEnergy += seamEnergyPerChannelRow(data, y, data->width);
+    }
+
+    return seamEnergy;
+}
+
+/// @brief Remove the seams from one row of the image in place (width is the width before the removal), returns the
+/// energy of the removed pixels (the energy row is not compacted yet, nothing with a luminance plane)
+static inline unsigned long long seamRemoveRowInPlace(ImageProcessData* data, int y, int width)
+{
+    const int* seamX = &data->seamPath[y * data->seamCount];
+    unsigned long long seamEnergy = 0;
+    for (int seamIdx = 0; seamIdx < data->seamCount && data->imgEnergy != NULL && data->imgLuminance == NULL; seamIdx++)
+    {
+        seamEnergy += data->imgEnergy[getPixelIdx(seamX[seamIdx], y, data->stride)];
+    }
+
+    seamCompactRow(&data->img[getPixelIdxC(0, y, data->stride, data->channelCount)],
+                   seamX, data->seamCount, width, data->channelCount);
+    if (data->imgLuminance != NULL)
+    {
+        seamCompactRow(&data->imgLuminance[getPixelIdx(0, y, data->stride)], seamX, data->seamCount, width, sizeof(unsigned char));
+    }
+    if (data->seamOrderMap != NULL)
+    {
+        // The stride is the source width, so stride - width seams were removed before this pass (the seams of a pass
+        // are numbered from left to right, they don't cross, so every prefix of them is still a set of whole seams)
+        int* columnRow = &data->pixelColumns[getPixelIdx(0, y, data->stride)];
+        unsigned short* seamOrderRow = &data->seamOrderMap[getPixelIdx(0, y, data->stride)];
+        for (int seamIdx = 0; seamIdx < data->seamCount; seamIdx++)
+        {
+            seamOrderRow[columnRow[seamX[seamIdx]]] = (unsigned short) (data->stride - width + seamIdx);
+        }
+        seamCompactRow(columnRow, seamX, data->seamCount, width, sizeof(int));
+    }
+    return seamEnergy;
+}
+
+/// @brief Remove the seams from the image
+void seamRemove(ImageProcessData* processData)
+{
+    const int seamCount = processData->seamCount;
+
+    // Compact the image in place (rows keep their stride, only the pixels right of the first seam move)
+    /// Parallel:
+    // - standard for parallel, as the rows are nicely devided between threads and each row only touches itself
+    // - only the tail of each row after the seam is moved (memmove), nothing is allocated or copied whole
+    // - the energy of the seam pixels is summed before it is compacted in the next energy step
+    // - the luminance plane is compacted with the image, it is never recalculated
+    const bool perChannelSeamEnergy = processData->imgLuminance != NULL || seamKernels.energyFunction == ENERGY_FORWARD;
+    unsigned long long seamEnergy = perChannelSeamEnergy ? seamEnergyPerChannel(processData) : 0;
+    #pragma omp parallel for reduction(+:seamEnergy)
+    for (int y = 0; y < processData->height; y++)
+    {
+        seamEnergy += seamRemoveRowInPlace(processData, y, processData->width);
+    }
+    processData->seamEnergy += seamEnergy;
+
+    // Update process data
+    processData->width = processData->width - seamCount;
+    processData->height = processData->height;
+    processData->channelCount = processData->channelCount;
+}
+
+#ifdef RENDER_LOADING_BAR_WIDTH
+/// @brief Update the loading bar
+void updatePrintLoadingBar(int progress, int total)
+{
+    static int lastProgress = -1;
+    if (lastProgress != -1) {
+        printf("\033[F"); // Move cursor up one line
+    }
+
+    int percent = (progress * 100) / total;
+    int filled = (progress * RENDER_LOADING_BAR_WIDTH) / total;
+
+    printf("[");  // Carriage return to overwrite line
+    for (int i = 0; i < filled; i++) printf("=");
+    for (int i = filled; i < RENDER_LOADING_BAR_WIDTH; i++) printf(" ");
+    printf("] %d%%\n", percent);
+
+    fflush(stdout);
+    lastProgress = progress;
+}
+#endif
+
+/// @brief Remove seamCount seams, every step opens its own parallel region(s), the annotate step may return up to
+/// seamsPerPass seams per pass
+void carveSeams(ImageProcessData* processData, int seamCount, int seamsPerPass, TimingStats* timingStats, SeamIdentificationFunc seamIdentificationFunc, SeamAnnotateFunc seamAnnotateFunc)
+{
+    for (int seamsRemoved = 0; seamsRemoved < seamCount; seamsRemoved += processData->seamCount)
+    {
+        // printf("Processing seam %d/%d\n", seamsRemoved + 1, seamCount);
+        processData->seamsPerPass = min(seamsPerPass, seamCount - seamsRemoved);
+
+        // Energy step
+        double startEnergyTime = omp_get_wtime();
+        if (seamsRemoved != 0 && processData->imgEnergy != NULL) {
+            updateEnergyOnSeam(processData);
+        }
+        double stopEnergyTime = omp_get_wtime();
+        timingStats->energyCalculations += stopEnergyTime - startEnergyTime;
+
+        // Seam identification step
+        double startSeamTime = omp_get_wtime();
+        seamIdentificationFunc(processData);
+        double stopSeamTime = omp_get_wtime();
+        timingStats->seamIdentifications += stopSeamTime - startSeamTime;
+
+        // Seam annotate step
+        double startAnnotateTime = omp_get_wtime();
+        seamAnnotateFunc(processData);
+        double stopAnnotateTime = omp_get_wtime();
+        timingStats->seamAnnotates += stopAnnotateTime - startAnnotateTime;
+
+        // Seam remove step
+        double startSeamRemoveTime = omp_get_wtime();
+        seamRemove(processData);
+        double stopSeamRemoveTime = omp_get_wtime();
+        timingStats->seamRemoves += stopSeamRemoveTime - startSeamRemoveTime;
+
+#ifdef RENDER_LOADING_BAR_WIDTH
+        updatePrintLoadingBar(seamsRemoved + processData->seamCount, seamCount);
+#endif
+    }
+}
+
+/// @brief Remove seamCount seams inside one parallel region (persistent thread team)
+void carveSeamsPersistent(ImageProcessData* processData, int seamCount, TimingStats* timingStats)
+{
+    const int height = processData->height;
+    const bool perChannelSeamEnergy = processData->imgLuminance != NULL;
+
+    if (processData->imgSeam == NULL)
+    {
+        processData->imgSeam = seamPlaneAlloc(processData->stride, height);
+    }
+
+    /// Parallel:
+    // - the team is created once, steps are separated by barriers instead of fork/joins
+    // - the image and energy rows are compacted in place like in seamRemove and updateEnergyOnSeam, each thread owns
+    //   the same block of rows in the energy and remove steps (stays in its cache and NUMA node) and the same range
+    //   of columns in every DP row
+    // - the seam annotate step is serial and runs on a single thread
+    #pragma omp parallel
+    {
+        const int threadIdx = omp_get_thread_num();
+        const int threadCount = omp_get_num_threads();
+        const int stride = processData->stride;
+
+        int yStart, yEnd;
+        getThreadRange(height, 1, threadIdx, threadCount, &yStart, &yEnd);
+
+        double phaseStartTime = omp_get_wtime();
+        for (int i = 0; i < seamCount; i++)
+        {
+            // Width before this seam (the annotate step sets the width after it)
+            const int width = processData->width;
+
+            int xStart, xEnd;
+            getThreadRange(width, THREAD_RANGE_ALIGN, threadIdx, threadCount, &xStart, &xEnd);
+
+            // Energy step (the image rows around y are already compacted)
+            for (int y = yStart; y < yEnd; y++)
+            {
+                if (i != 0)
+                {
+                    updateEnergyOnSeamRowInPlace(processData, y);
+                }
+                seamRowSetGuards(getSeamRow(processData->imgSeam, y, stride), width);
+            }
+            #pragma omp barrier
+            #pragma omp master
+            {
+                timingStats->energyCalculations += omp_get_wtime() - phaseStartTime;
+                phaseStartTime = omp_get_wtime();
+            }
+
+            // Seam identification step
+            seamRowCopyEnergy(getSeamRow(processData->imgSeam, height - 1, stride),
+                              &processData->imgEnergy[getPixelIdx(0, height - 1, stride)], xStart, xEnd);
+            #pragma omp barrier
+            for (int y = height - 2; y >= 0; y--)
+            {
+                ENERGY_KERNEL(dpRow)(getSeamRow(processData->imgSeam, y + 1, stride),
+                                     &processData->imgEnergy[getPixelIdx(0, y, stride)],
+                                     getSeamRow(processData->imgSeam, y, stride),
+                                     xStart, xEnd);
+                #pragma omp barrier
+            }
+            #pragma omp master
+            {
+                timingStats->seamIdentifications += omp_get_wtime() - phaseStartTime;
+                phaseStartTime = omp_get_wtime();
+            }
+
+            // Seam annotate step
+            #pragma omp single
+            {
+                seamAnnotate(processData);
+                processData->width = width - 1;
+            }
+            #pragma omp master
+            {
+                timingStats->seamAnnotates += omp_get_wtime() - phaseStartTime;
+                phaseStartTime = omp_get_wtime();
+            }
+
+            // Seam remove step (the per-channel seam energy reads the neighbouring rows, so it is summed before any
+            // row is compacted)
+            unsigned long long seamEnergy = 0;
+            if (perChannelSeamEnergy)
+            {
+                for (int y = yStart; y < yEnd; y++)
+                {
+                    seamEnergy += seamEnergyPerChannelRow(processData, y, width);
+                }
+                #pragma omp barrier
+            }
+            for (int y = yStart; y < yEnd; y++)
+            {
+                seamEnergy += seamRemoveRowInPlace(processData, y, width);
+            }
+            #pragma omp atomic
+            processData->seamEnergy += seamEnergy;
+            #pragma omp barrier
+            #pragma omp master
+            {
+                timingStats->seamRemoves += omp_get_wtime() - phaseStartTime;
+                phaseStartTime = omp_get_wtime();
+
+#ifdef RENDER_LOADING_BAR_WIDTH
+                updatePrintLoadingBar(i + 1, seamCount);
+#endif
+            }
+        }
+    }
+}
+
+/// @brief Get the rows [yStart, yEnd) of band bandIdx of the fused sweep, bands are counted from the bottom
+static inline void getFusedBand(int height, int bandRows, int bandIdx, int* yStart, int* yEnd)
+{
+    *yEnd = max(height - bandIdx * bandRows, 0);
+    *yStart = max(*yEnd - bandRows, 0);
+}
+
+/// @brief Remove seamCount seams with the remove, energy and DP steps of a seam fused into one bottom-up band sweep
+void carveSeamsFused(ImageProcessData* processData, int seamCount, TimingStats* timingStats)
+{
+    const int height = processData->height;
+
+    if (processData->imgSeam == NULL)
+    {
+        processData->imgSeam = seamPlaneAlloc(processData->stride, height);
+    }
+
+    for (int i = 0; i < seamCount; i++)
+    {
+        // Seam identification step (fused with removing the previous seam and updating the energy)
+        double startSeamTime = omp_get_wtime();
+        const bool removePrevious = i != 0;
+        if (removePrevious)
+        {
+            if (processData->imgLuminance != NULL)
+            {
+                processData->seamEnergy += seamEnergyPerChannel(processData);
+            }
+            processData->width -= processData->seamCount;
+        }
+
+        /// Parallel:
+        // - one parallel region per seam, the image is swept bottom-up in bands of rows
+        // - the energy of row y needs image rows y - 1 to y + 1 without the seam, so the update trails the removal by
+        //   one row: while the team removes the seam from band b + 1 it updates the energy of rows [start + 1, end + 1)
+        //   of band b (both split by rows, they touch disjoint rows), then the DP of those rows follows split by
+        //   columns with one barrier per row like seamIdentification
+        // - a band is removed, updated and read by the DP while it is still in cache instead of in three sweeps over
+        //   the whole image
+        #pragma omp parallel
+        {
+            const int threadIdx = omp_get_thread_num();
+            const int threadCount = omp_get_num_threads();
+            const int width = processData->width;
+            const int stride = processData->stride;
+            const int bandRows = max(FUSED_BAND_ROWS, threadCount);
+            const int bandCount = (height + bandRows - 1) / bandRows;
+
+            int xStart, xEnd;
+            getThreadRange(width, THREAD_RANGE_ALIGN, threadIdx, threadCount, &xStart, &xEnd);
+
+            unsigned long long seamEnergy = 0;
+            int yStart, yEnd;
+            getFusedBand(height, bandRows, 0, &yStart, &yEnd);
+            for (int bandIdx = 0; bandIdx < bandCount; bandIdx++)
+            {
+                // Remove the seam from this band before the first update reads it
+                if (removePrevious && bandIdx == 0)
+                {
+                    int rowStart, rowEnd;
+                    getThreadRange(yEnd - yStart, 1, threadIdx, threadCount, &rowStart, &rowEnd);
+                    for (int y = yStart + rowStart; y < yStart + rowEnd; y++)
+                    {
+                        seamEnergy += seamRemoveRowInPlace(processData, y, width + processData->seamCount);
+                    }
+                    #pragma omp barrier
+                }
+
+                // Remove the seam from the next band and update the energy of this band one row lower
+                int nextStart, nextEnd;
+                getFusedBand(height, bandRows, bandIdx + 1, &nextStart, &nextEnd);
+                const int updateStart = yStart == 0 ? 0 : yStart + 1;
+                const int updateEnd = min(yEnd + 1, height);
+
+                int rowStart, rowEnd;
+                getThreadRange(nextEnd - nextStart, 1, threadIdx, threadCount, &rowStart, &rowEnd);
+                for (int y = nextStart + rowStart; y < nextStart + rowEnd && removePrevious; y++)
+                {
+                    seamEnergy += seamRemoveRowInPlace(processData, y, width + processData->seamCount);
+                }
+                getThreadRange(updateEnd - updateStart, 1, threadIdx, threadCount, &rowStart, &rowEnd);
+                for (int y = updateStart + rowStart; y < updateStart + rowEnd; y++)
+                {
+                    if (removePrevious)
+                    {
+                        updateEnergyOnSeamRowInPlace(processData, y);
+                    }
+                    seamRowSetGuards(getSeamRow(processData->imgSeam, y, stride), width);
+                }
+                #pragma omp barrier
+
+                // DP of the updated rows
+                for (int y = updateEnd - 1; y >= updateStart; y--)
+                {
+                    if (y == height - 1)
+                    {
+                        seamRowCopyEnergy(getSeamRow(processData->imgSeam, y, stride),
+                                          &processData->imgEnergy[getPixelIdx(0, y, stride)], xStart, xEnd);
+                    }
+                    else
+                    {
+                        ENERGY_KERNEL(dpRow)(getSeamRow(processData->imgSeam, y + 1, stride),
+                                             &processData->imgEnergy[getPixelIdx(0, y, stride)],
+                                             getSeamRow(processData->imgSeam, y, stride),
+                                             xStart, xEnd);
+                    }
+                    #pragma omp barrier
+                }
+
+                yStart = nextStart;
+                yEnd = nextEnd;
+            }
+
+            #pragma omp atomic
+            processData->seamEnergy += seamEnergy;
+        }
+        double stopSeamTime = omp_get_wtime();
+        timingStats->seamIdentifications += stopSeamTime - startSeamTime;
+
+        // Seam annotate step
+        double startAnnotateTime = omp_get_wtime();
+        seamAnnotate(processData);
+        double stopAnnotateTime = omp_get_wtime();
+        timingStats->seamAnnotates += stopAnnotateTime - startAnnotateTime;
+
+#ifdef RENDER_LOADING_BAR_WIDTH
+        updatePrintLoadingBar(i + 1, seamCount);
+#endif
+    }
+
+    // Seam remove step (only the last seam, the others were removed in the sweeps)
+    double startSeamRemoveTime = omp_get_wtime();
+    if (seamCount > 0)
+    {
+        seamRemove(processData);
+    }
+    double stopSeamRemoveTime = omp_get_wtime();
+    timingStats->seamRemoves += stopSeamRemoveTime - startSeamRemoveTime;
+}
+
+/// @brief Transpose one tile (rows [y0, y1) and columns [x0, x1) of src) into dst, CHANNELS bytes per pixel
+__attribute__((always_inline))
+static inline void transposeTile(unsigned char* dst, const unsigned char* src, int height, int srcStride, int x0, int x1, int y0, int y1, const int CHANNELS)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        const unsigned char* srcPixel = &src[(size_t) getPixelIdxC(x0, y, srcStride, CHANNELS)];
+        unsigned char* dstPixel = &dst[(size_t) getPixelIdxC(y, x0, height, CHANNELS)];
+        for (int x = x0; x < x1; x++, srcPixel += CHANNELS, dstPixel += (size_t) height * CHANNELS)
+        {
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                dstPixel[c] = srcPixel[c];
+            }
+        }
+    }
+}
+
+/// @brief Transpose an image (width x height pixels, srcStride pixels per row) into dst (height x width pixels, packed)
+static void transposeImage(unsigned char* dst, const unsigned char* src, int width, int height, int srcStride, int channelCount)
+{
+    /// Parallel:
+    // - the image is cut into TRANSPOSE_TILE x TRANSPOSE_TILE tiles, a tile reads TRANSPOSE_TILE short source rows and
+    //   writes TRANSPOSE_TILE short destination rows, so both sides stay in cache (and in the TLB, every row is on its
+    //   own page) instead of one side striding through the whole image per pixel
+    // - 16 was the fastest tile on 8K RGB (about 0.2s against 0.35s untiled on one core, 64 is slower from TLB misses)
+    // - tiles are independent, collapse(2) spreads the tile grid over the threads
+    // - the tile copy is generated for 1, 3 and 4 channels (like the other per pixel channel loops)
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (int y0 = 0; y0 < height; y0 += TRANSPOSE_TILE)
+    {
+        for (int x0 = 0; x0 < width; x0 += TRANSPOSE_TILE)
+        {
+            int y1 = min(y0 + TRANSPOSE_TILE, height);
+            int x1 = min(x0 + TRANSPOSE_TILE, width);
+            switch (channelCount)
+            {
+                case 1:  transposeTile(dst, src, height, srcStride, x0, x1, y0, y1, 1); break;
+                case 3:  transposeTile(dst, src, height, srcStride, x0, x1, y0, y1, 3); break;
+                case 4:  transposeTile(dst, src, height, srcStride, x0, x1, y0, y1, 4); break;
+                default: transposeTile(dst, src, height, srcStride, x0, x1, y0, y1, channelCount); break;
+            }
+        }
+    }
+}
+
+/// @brief Free the buffers that belong to the current orientation (energy, luminance, cumulative energy, seams), the
+/// engines allocate them again for the new dimensions
+static inline void processDataFreeBuffers(ImageProcessData* data)
+{
+    free(data->imgLuminance);
+    free(data->imgEnergy);
+    free(data->imgSeam);
+    free(data->seamDirections);
+    free(data->seamTransfers);
+    free(data->seamPath);
+    data->imgLuminance = NULL;
+    data->imgEnergy = NULL;
+    data->imgSeam = NULL;
+    data->seamDirections = NULL;
+    data->seamTransfers = NULL;
+    data->seamPath = NULL;
+    data->seamCount = 0;
+    data->energyCurrent = false;
+}
+
+/// @brief Transpose the image in memory (horizontal seams become vertical seams of the transposed image) into the spare
+/// image buffer and swap the two, the result is packed (stride == width)
+void transposeProcessData(ImageProcessData* data, unsigned char** spareImg)
+{
+    processDataFreeBuffers(data);
+
+    // The spare buffer is allocated once with the size of the image before the first transpose, later images are
+    // smaller, so every transpose after the first writes into memory that is already paged in
+    if (*spareImg == NULL)
+    {
+        *spareImg = (unsigned char *) malloc(sizeof(unsigned char) * data->width * data->height * data->channelCount);
+    }
+    unsigned char* transposed = *spareImg;
+    transposeImage(transposed, data->img, data->width, data->height, data->stride, data->channelCount);
+    *spareImg = data->img;
+
+    int width = data->width;
+    data->img = transposed;
+    data->width = data->height;
+    data->height = width;
+    data->stride = data->width;
+}
+
+/// @brief Remove seamCount vertical seams of the current orientation with the selected engine (energy included)
+void carveSeamsWithEngine(ImageProcessData* processData, int seamCount, const ProcessOptions* options, TimingStats* timingStats)
+{
+    // Streaming and forward energy have no energy plane, the DP calculates the energy (costs) of every row itself
+    double startEnergyTime = omp_get_wtime();
+    if (options->luminance && processData->imgLuminance == NULL)
+    {
+        calculateLuminance(processData);
+    }
+    if (!options->streamingEnergy && options->energyFunction != ENERGY_FORWARD && !processData->energyCurrent)
+    {
+        calculateEnergyFull(processData);
+    }
+    processData->energyCurrent = false;
+    double stopEnergyTime = omp_get_wtime();
+    timingStats->energyCalculations += stopEnergyTime - startEnergyTime;
+
+    switch (options->engine)
+    {
+        case ENGINE_PERSISTENT:
+            carveSeamsPersistent(processData, seamCount, timingStats);
+            break;
+        case ENGINE_TRAPEZOID:
+            carveSeams(processData, seamCount, 1, timingStats, trapezoidSeamIdentification, seamAnnotate);
+            break;
+        case ENGINE_INCREMENTAL:
+            carveSeams(processData, seamCount, 1, timingStats, incrementalSeamIdentification, seamAnnotate);
+            break;
+        case ENGINE_ROLLING:
+            carveSeams(processData, seamCount, 1, timingStats,
+                       options->energyFunction == ENERGY_FORWARD ? forwardSeamIdentification : rollingSeamIdentification,
+                       rollingSeamAnnotate);
+            break;
+        case ENGINE_FUSED:
+            carveSeamsFused(processData, seamCount, timingStats);
+            break;
+        case ENGINE_MINPLUS:
+            carveSeams(processData, seamCount, 1, timingStats, minPlusSeamIdentification, seamAnnotate);
+            break;
+        case ENGINE_BIDIRECTIONAL:
+            carveSeams(processData, seamCount, 1, timingStats, bidirectionalSeamIdentification, bidirectionalSeamAnnotate);
+            break;
+        case ENGINE_MULTI:
+            carveSeams(processData, seamCount, options->seamsPerPass, timingStats, seamIdentification, multiSeamAnnotate);
+            break;
+        default:
+            carveSeams(processData, seamCount, 1, timingStats, options->streamingEnergy ? streamingSeamIdentification : seamIdentification, seamAnnotate);
+            break;
+    }
+}
+
+// SEAM ORDER MAP ////////////////////////////////////////////////////////////////////////
+
+/// @brief Start recording the seam order map (every pixel is kept and in its source column), the engines fill it in
+/// while they remove the seams
+void seamOrderMapInit(ImageProcessData* data)
+{
+    data->pixelColumns = (int *) malloc(sizeof(int) * data->stride * data->height);
+    data->seamOrderMap = (unsigned short *) malloc(sizeof(unsigned short) * data->stride * data->height);
+
+    /// Parallel:
+    // - rows are independent
+    #pragma omp parallel for
+    for (int y = 0; y < data->height; y++)
+    {
+        for (int x = 0; x < data->width; x++)
+        {
+            data->pixelColumns[getPixelIdx(x, y, data->stride)] = x;
+            data->seamOrderMap[getPixelIdx(x, y, data->stride)] = SEAM_ORDER_KEPT;
+        }
+    }
+}
+
+/// @brief Write the recorded seam order map of seamCount seams (source width x height) to a file
+bool writeSeamOrderMap(const char* path, const unsigned short* seamOrderMap, int width, int height, int seamCount)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    SeamMapHeader header;
+    memcpy(header.magic, SEAM_MAP_MAGIC, sizeof(header.magic));
+    header.width = width;
+    header.height = height;
+    header.seamCount = seamCount;
+    bool written = fwrite(&header, sizeof(SeamMapHeader), 1, file) == 1 &&
+                   fwrite(seamOrderMap, sizeof(unsigned short), (size_t) width * height, file) == (size_t) width * height;
+    fclose(file);
+    return written;
+}
+
+/// @brief Read a seam order map for a width x height source image, returns NULL if the file doesn't hold one
+unsigned short* readSeamOrderMap(const char* path, int width, int height, int* seamCount)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    SeamMapHeader header;
+    unsigned short* seamOrderMap = NULL;
+    if (fread(&header, sizeof(SeamMapHeader), 1, file) == 1 && memcmp(header.magic, SEAM_MAP_MAGIC, sizeof(header.magic)) == 0 &&
+        header.width == width && header.height == height)
+    {
+        seamOrderMap = (unsigned short *) malloc(sizeof(unsigned short) * width * height);
+        if (fread(seamOrderMap, sizeof(unsigned short), (size_t) width * height, file) != (size_t) width * height)
+        {
+            free(seamOrderMap);
+            seamOrderMap = NULL;
+        }
+        *seamCount = header.seamCount;
+    }
+    fclose(file);
+    return seamOrderMap;
+}
+
+/// @brief Remove the first seamCount seams of a seam order map from the image in one pass (the pixels with a seam
+/// order below seamCount), the result is the image the recording engine produced after seamCount seams
+void seamOrderMapApply(ImageProcessData* data, const unsigned short* seamOrderMap, int seamCount)
+{
+    const int width = data->width;
+    const int channelCount = data->channelCount;
+
+    /// Parallel:
+    // - rows are independent, every row loses exactly seamCount pixels (one per seam)
+    // - the kept runs between the removed pixels are moved left in place with one memmove each, like seamCompactRow
+    #pragma omp parallel for
+    for (int y = 0; y < data->height; y++)
+    {
+        unsigned char* row = &data->img[getPixelIdxC(0, y, data->stride, channelCount)];
+        const unsigned short* seamOrderRow = &seamOrderMap[getPixelIdx(0, y, width)];
+        int keptX = 0;
+        int runStart = 0;
+        for (int x = 0; x <= width; x++)
+        {
+            if (x == width || seamOrderRow[x] < seamCount)
+            {
+                memmove(&row[keptX * channelCount], &row[runStart * channelCount], sizeof(unsigned char) * (x - runStart) * channelCount);
+                keptX += x - runStart;
+                runStart = x + 1;
+            }
+        }
+    }
+
+    data->width = width - seamCount;
+}
+
+/// @brief Insert seamCount seams (content-aware enlargement), the seams are found in batches by removing them from a
+/// scratch copy while its seam order map is recorded, then every row is copied once into the preallocated wider image,
+/// with a new pixel after every seam pixel (the average of the seam pixel and its right neighbour)
+void insertSeams(ImageProcessData* processData, int seamCount, const ProcessOptions* options, TimingStats* timingStats)
+{
+    for (int seamsInserted = 0; seamsInserted < seamCount;)
+    {
+        // A batch takes at most half the width, more would stretch the same low energy seams again and again (a batch
+        // can't have more seams than a row has pixels anyway)
+        const int width = processData->width;
+        const int height = processData->height;
+        const int channelCount = processData->channelCount;
+        const int batchSeams = min(min(seamCount - seamsInserted, max(width / 2, 1)), SEAM_ORDER_KEPT - 1);
+
+        // Batch seam discovery: carve them from a scratch copy
+        ImageProcessData scratch = {0};
+        scratch.img = (unsigned char *) malloc(sizeof(unsigned char) * width * height * channelCount);
+        scratch.width = width;
+        scratch.height = height;
+        scratch.stride = width;
+        scratch.channelCount = channelCount;
+        for (int y = 0; y < height; y++)
+        {
+            memcpy(&scratch.img[getPixelIdxC(0, y, width, channelCount)],
+                   &processData->img[getPixelIdxC(0, y, processData->stride, channelCount)], sizeof(unsigned char) * width * channelCount);
+        }
+        seamOrderMapInit(&scratch);
+        carveSeamsWithEngine(&scratch, batchSeams, options, timingStats);
+        processData->seamEnergy += scratch.seamEnergy;
+
+        // Insert all seams of the batch in one pass
+        double startSeamInsertTime = omp_get_wtime();
+        const int insertedWidth = width + batchSeams;
+        unsigned char* inserted = (unsigned char *) malloc(sizeof(unsigned char) * insertedWidth * height * channelCount);
+
+        /// Parallel:
+        // - rows are independent, every row gets exactly batchSeams new pixels (one per seam)
+        // - the runs between the seam pixels are copied with one memcpy each, like seamOrderMapApply
+        #pragma omp parallel for
+        for (int y = 0; y < height; y++)
+        {
+            const unsigned char* row = &processData->img[getPixelIdxC(0, y, processData->stride, channelCount)];
+            const unsigned short* seamOrderRow = &scratch.seamOrderMap[getPixelIdx(0, y, width)];
+            unsigned char* insertedRow = &inserted[getPixelIdxC(0, y, insertedWidth, channelCount)];
+            int insertedX = 0;
+            int runStart = 0;
+            for (int x = 0; x < width; x++)
+            {
+                if (seamOrderRow[x] < batchSeams)
+                {
+                    memcpy(&insertedRow[insertedX * channelCount], &row[runStart * channelCount], sizeof(unsigned char) * (x + 1 - runStart) * channelCount);
+                    insertedX += x + 1 - runStart;
+                    runStart = x + 1;
+
+                    const unsigned char* right = &row[min(x + 1, width - 1) * channelCount];
+                    for (int c = 0; c < channelCount; c++)
+                    {
+                        insertedRow[insertedX * channelCount + c] = (unsigned char) ((row[x * channelCount + c] + right[c] + 1) >> 1);
+                    }
+                    insertedX++;
+                }
+            }
+            memcpy(&insertedRow[insertedX * channelCount], &row[runStart * channelCount], sizeof(unsigned char) * (width - runStart) * channelCount);
+        }
+
+        processDataFreeBuffers(processData);
+        free(processData->img);
+        processData->img = inserted;
+        processData->width = insertedWidth;
+        processData->stride = insertedWidth;
+        double stopSeamInsertTime = omp_get_wtime();
+        timingStats->seamInserts += stopSeamInsertTime - startSeamInsertTime;
+
+        processDataFreeBuffers(&scratch);
+        free(scratch.pixelColumns);
+        free(scratch.seamOrderMap);
+        free(scratch.img);
+        seamsInserted += batchSeams;
+    }
+}
+
+// IMAGE CARVING /////////////////////////////////////////////////////////////////////////
+
+/// @brief Remove one vertical or horizontal seam from a copy of a state image (width x height, the state's own
+/// orientation is transposed if its last seam was horizontal) with the selected engine, the new state is packed and
+/// stays in the orientation of the seam (horizontal seams are vertical seams of the transposed image)
+static TransportState transportStep(const TransportState* state, int width, int height, int channelCount, bool horizontal, const ProcessOptions* options, TimingStats* timingStats)
+{
+    ImageProcessData data = {0};
+    data.img = (unsigned char *) malloc(sizeof(unsigned char) * width * height * channelCount);
+    data.width = horizontal ? height : width;
+    data.height = horizontal ? width : height;
+    data.stride = data.width;
+    data.channelCount = channelCount;
+    if (state->transposed != horizontal)
+    {
+        double startTransposeTime = omp_get_wtime();
+        transposeImage(data.img, state->img, data.height, data.width, data.height, channelCount);
+        double stopTransposeTime = omp_get_wtime();
+        timingStats->transposes += stopTransposeTime - startTransposeTime;
+    }
+    else
+    {
+        memcpy(data.img, state->img, sizeof(unsigned char) * width * height * channelCount);
+    }
+
+    carveSeamsWithEngine(&data, 1, options, timingStats);
+    processDataFreeBuffers(&data);
+
+    // Pack the result (the engines compact the rows in place, but keep the stride)
+    for (int y = 1; y < data.height && data.stride != data.width; y++)
+    {
+        memmove(&data.img[getPixelIdxC(0, y, data.width, channelCount)],
+                &data.img[getPixelIdxC(0, y, data.stride, channelCount)], sizeof(unsigned char) * data.width * channelCount);
+    }
+
+    TransportState nextState = { data.img, state->cost + data.seamEnergy, horizontal };
+    return nextState;
+}
+
+/// @brief Remove verticalSeams vertical and horizontalSeams horizontal seams in the order with the least total seam
+/// energy, found with the transport map DP over the states (r, c) = image after r horizontal and c vertical seams:
+/// T(r, c) = min(T(r - 1, c) + E(horizontal seam of (r - 1, c)), T(r, c - 1) + E(vertical seam of (r, c - 1)))
+/// (every state carries the image of its cheaper predecessor, like in the paper, so the image of the last state is the
+/// result and no backtracking is needed)
+void carveImageOptimal(ImageProcessData* processData, int verticalSeams, int horizontalSeams, const ProcessOptions* options, TimingStats* timingStats)
+{
+    const int width = processData->width;
+    const int height = processData->height;
+    const int channelCount = processData->channelCount;
+
+    // The states of the anti-diagonal r + c = d only depend on the states of diagonal d - 1, so only two diagonals of
+    // images are kept (indexed by r), at most 2 * (min(verticalSeams, horizontalSeams) + 1) images at a time
+    TransportState* previous = (TransportState *) calloc(horizontalSeams + 1, sizeof(TransportState));
+    TransportState* current = (TransportState *) calloc(horizontalSeams + 1, sizeof(TransportState));
+
+    // Diagonal 0 is the input image
+    previous[0].img = (unsigned char *) malloc(sizeof(unsigned char) * width * height * channelCount);
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(&previous[0].img[getPixelIdxC(0, y, width, channelCount)],
+               &processData->img[getPixelIdxC(0, y, processData->stride, channelCount)], sizeof(unsigned char) * width * channelCount);
+    }
+    previous[0].cost = 0;
+    previous[0].transposed = false;
+
+    for (int diagonal = 1; diagonal <= verticalSeams + horizontalSeams; diagonal++)
+    {
+        const int rStart = max(0, diagonal - verticalSeams);
+        const int rEnd = min(diagonal, horizontalSeams);
+
+        /// Parallel:
+        // - the states of a diagonal are independent, every state carves its (up to) two candidates with the engine in
+        //   a nested parallel region (one thread, unless nested parallelism is enabled), so the threads are spread over
+        //   the states of the diagonal instead of the rows of one image
+        // - dynamic, the states at the edges of the map only have one candidate
+        // - each candidate carves its own copy of the shared predecessor image, the predecessors are only read
+        // - the step timings of the states are summed atomically
+        #pragma omp parallel for schedule(dynamic)
+        for (int r = rStart; r <= rEnd; r++)
+        {
+            const int c = diagonal - r;
+            const int stateWidth = width - c;
+            const int stateHeight = height - r;
+            TimingStats stepTimingStats = {0};
+
+            // One more vertical seam from state (r, c - 1) or one more horizontal seam from state (r - 1, c), ties go
+            // to the vertical seam (like the vertical first order)
+            TransportState verticalState = { NULL, ULLONG_MAX, false };
+            TransportState horizontalState = { NULL, ULLONG_MAX, true };
+            if (c > 0)
+            {
+                verticalState = transportStep(&previous[r], stateWidth + 1, stateHeight, channelCount, false, options, &stepTimingStats);
+            }
+            if (r > 0)
+            {
+                horizontalState = transportStep(&previous[r - 1], stateWidth, stateHeight + 1, channelCount, true, options, &stepTimingStats);
+            }
+            if (verticalState.cost <= horizontalState.cost)
+            {
+                current[r] = verticalState;
+                free(horizontalState.img);
+            }
+            else
+            {
+                current[r] = horizontalState;
+                free(verticalState.img);
+            }
+
+            #pragma omp atomic
+            timingStats->energyCalculations += stepTimingStats.energyCalculations;
+            #pragma omp atomic
+            timingStats->seamIdentifications += stepTimingStats.seamIdentifications;
+            #pragma omp atomic
+            timingStats->seamAnnotates += stepTimingStats.seamAnnotates;
+            #pragma omp atomic
+            timingStats->seamRemoves += stepTimingStats.seamRemoves;
+            #pragma omp atomic
+            timingStats->transposes += stepTimingStats.transposes;
+        }
+
+        // Diagonal d - 1 is no longer needed
+        for (int r = max(0, diagonal - 1 - verticalSeams); r <= min(diagonal - 1, horizontalSeams); r++)
+        {
+            free(previous[r].img);
+            previous[r].img = NULL;
+        }
+        TransportState* swap = previous;
+        previous = current;
+        current = swap;
+    }
+
+    // The last diagonal only holds the state (horizontalSeams, verticalSeams)
+    TransportState* lastState = &previous[horizontalSeams];
+    processDataFreeBuffers(processData);
+    processData->width = width - verticalSeams;
+    processData->height = height - horizontalSeams;
+    processData->stride = processData->width;
+    processData->seamEnergy += lastState->cost;
+    if (lastState->transposed)
+    {
+        double startTransposeTime = omp_get_wtime();
+        transposeImage(processData->img, lastState->img, processData->height, processData->width, processData->height, channelCount);
+        double stopTransposeTime = omp_get_wtime();
+        timingStats->transposes += stopTransposeTime - startTransposeTime;
+        free(lastState->img);
+    }
+    else
+    {
+        free(processData->img);
+        processData->img = lastState->img;
+    }
+
+    free(previous);
+    free(current);
+}
+
+/// @brief Remove verticalSeams vertical and horizontalSeams horizontal seams in the seam order of the options
+/// (horizontal seams are carved as vertical seams of the transposed image, the image is only decoded once), a negative
+/// verticalSeams inserts -verticalSeams seams first
+void carveImage(ImageProcessData* processData, int verticalSeams, int horizontalSeams, const ProcessOptions* options, TimingStats* timingStats)
+{
+    if (verticalSeams < 0)
+    {
+        insertSeams(processData, -verticalSeams, options, timingStats);
+        verticalSeams = 0;
+    }
+
+    if (options->seamOrder == SEAM_ORDER_OPTIMAL)
+    {
+        carveImageOptimal(processData, verticalSeams, horizontalSeams, options, timingStats);
+        return;
+    }
+
+    int verticalLeft = verticalSeams;
+    int horizontalLeft = horizontalSeams;
+    bool transposed = false;
+    unsigned char* spareImg = NULL;
+    while (verticalLeft > 0 || horizontalLeft > 0)
+    {
+        // Orientation and seams of the next block
+        bool horizontal;
+        switch (options->seamOrder)
+        {
+            case SEAM_ORDER_HORIZONTAL_FIRST:
+                horizontal = horizontalLeft > 0;
+                break;
+            case SEAM_ORDER_ALTERNATE:
+                // The orientation that is further from its target (relative to its seam count) goes next
+                horizontal = (long long) horizontalLeft * verticalSeams > (long long) verticalLeft * horizontalSeams;
+                break;
+            default:
+                horizontal = verticalLeft == 0;
+                break;
+        }
+        int* seamsLeft = horizontal ? &horizontalLeft : &verticalLeft;
+        int blockSeams = options->seamOrder == SEAM_ORDER_ALTERNATE ? min(*seamsLeft, options->seamBlock) : *seamsLeft;
+
+        if (horizontal != transposed)
+        {
+            double startTransposeTime = omp_get_wtime();
+            transposeProcessData(processData, &spareImg);
+            double stopTransposeTime = omp_get_wtime();
+            timingStats->transposes += stopTransposeTime - startTransposeTime;
+            transposed = horizontal;
+        }
+
+        carveSeamsWithEngine(processData, blockSeams, options, timingStats);
+        *seamsLeft -= blockSeams;
+    }
+
+    if (transposed)
+    {
+        double startTransposeTime = omp_get_wtime();
+        transposeProcessData(processData, &spareImg);
+        double stopTransposeTime = omp_get_wtime();
+        timingStats->transposes += stopTransposeTime - startTransposeTime;
+    }
+    free(spareImg);
+}
+
+/// @brief Carve the input image again one seam at a time (default engine, rolling with forward energy, per-channel energy,
+/// same seam order) and compare the result with the carved data, returns false if the input image can't be loaded again
+bool measureDrift(const ImageProcessData* processData, const char* imageInPath, int verticalSeams, int horizontalSeams, const ProcessOptions* options, DriftStats* drift)
+{
+    ImageProcessData exactData = {0};
+    exactData.img = stbi_load(imageInPath, &exactData.width, &exactData.height, &exactData.channelCount, STB_COLOR_CHANNELS);
+    if (exactData.img == NULL)
+    {
+        printf("Error: Couldn't load image again for the drift check\n");
+        return false;
+    }
+    exactData.stride = exactData.width;
+
+    // Forward energy has no energy plane, its exact result is the rolling engine's
+    ProcessOptions exactOptions = *options;
+    exactOptions.engine = options->energyFunction == ENERGY_FORWARD ? ENGINE_ROLLING : ENGINE_DEFAULT;
+    exactOptions.seamsPerPass = 1;
+    exactOptions.streamingEnergy = false;
+    exactOptions.luminance = false;
+
+    TimingStats exactTimingStats = {0};
+    carveImage(&exactData, verticalSeams, horizontalSeams, &exactOptions, &exactTimingStats);
+
+    // Compare the two images
+    /// Parallel:
+    // - rows are independent, the counters are reductions
+    unsigned long long changedPixels = 0;
+    unsigned long long absoluteError = 0;
+    #pragma omp parallel for reduction(+:changedPixels, absoluteError)
+    for (int y = 0; y < processData->height; y++)
+    {
+        for (int x = 0; x < processData->width; x++)
+        {
+            const unsigned char* pixel = &processData->img[getPixelIdxC(x, y, processData->stride, processData->channelCount)];
+            const unsigned char* exactPixel = &exactData.img[getPixelIdxC(x, y, exactData.stride, exactData.channelCount)];
+
+            bool changed = false;
+            for (int c = 0; c < processData->channelCount; c++)
+            {
+                absoluteError += abs(pixel[c] - exactPixel[c]);
+                changed |= pixel[c] != exactPixel[c];
+            }
+            changedPixels += changed;
+        }
+    }
+
+    unsigned long long pixelCount = (unsigned long long) processData->width * processData->height;
+    drift->seamEnergy = processData->seamEnergy;
+    drift->exactSeamEnergy = exactData.seamEnergy;
+    drift->seamEnergyIncrease = exactData.seamEnergy > 0 ? (double) processData->seamEnergy / exactData.seamEnergy - 1 : 0;
+    drift->changedPixels = (double) changedPixels / pixelCount;
+    drift->meanAbsoluteError = (double) absoluteError / (pixelCount * processData->channelCount);
+
+    processDataFreeBuffers(&exactData);
+    free(exactData.img);
+    return true;
+}
+
+/// @brief Parse the optional arguments after the seam count (--engine=<name>, --seams-per-pass=<k>, --streaming-energy,
+/// --luminance, --energy=<name>, --width=<w>, --height=<h>, --seam-order=<order>, --seam-block=<k>, --seam-map-out=<path>,
+/// --seam-map-in=<path>)
+bool parseOptions(int argc, char *args[], ProcessOptions* options)
+{
+    options->engine = ENGINE_DEFAULT;
+    options->seamsPerPass = 0;
+    options->streamingEnergy = false;
+    options->luminance = false;
+    options->energyFunction = ENERGY_SOBEL;
+    options->targetWidth = 0;
+    options->targetHeight = 0;
+    options->seamOrder = SEAM_ORDER_VERTICAL_FIRST;
+    options->seamBlock = SEAM_BLOCK_DEFAULT;
+    options->seamMapOut = NULL;
+    options->seamMapIn = NULL;
+
+    for (int argIdx = 4; argIdx < argc; argIdx++)
+    {
+        if (strncmp(args[argIdx], "--engine=", 9) == 0)
+        {
+            int engine = -1;
+            for (int e = 0; e < ENGINE_COUNT; e++)
+            {
+                if (strcmp(&args[argIdx][9], carvingEngineNames[e]) == 0) engine = e;
+            }
+
+            if (engine < 0)
+            {
+                printf("Error: Unknown engine %s.\n", &args[argIdx][9]);
+                return false;
+            }
+            options->engine = (CarvingEngine) engine;
+        }
+        else if (strncmp(args[argIdx], "--seams-per-pass=", 17) == 0)
+        {
+            options->seamsPerPass = atoi(&args[argIdx][17]);
+            if (options->seamsPerPass < 1)
+            {
+                printf("Error: Incorrect value for seams per pass.\n");
+                return false;
+            }
+        }
+        else if (strcmp(args[argIdx], "--streaming-energy") == 0)
+        {
+            options->streamingEnergy = true;
+        }
+        else if (strcmp(args[argIdx], "--luminance") == 0)
+        {
+            options->luminance = true;
+        }
+        else if (strncmp(args[argIdx], "--energy=", 9) == 0)
+        {
+            int energyFunction = -1;
+            for (int f = 0; f < ENERGY_FUNCTION_COUNT; f++)
+            {
+                if (strcmp(&args[argIdx][9], energyFunctionNames[f]) == 0) energyFunction = f;
+            }
+
+            if (energyFunction < 0)
+            {
+                printf("Error: Unknown energy function %s.\n", &args[argIdx][9]);
+                return false;
+            }
+            options->energyFunction = (EnergyFunction) energyFunction;
+        }
+        else if (strncmp(args[argIdx], "--width=", 8) == 0)
+        {
+            options->targetWidth = atoi(&args[argIdx][8]);
+            if (options->targetWidth < 1)
+            {
+                printf("Error: Incorrect value for the target width.\n");
+                return false;
+            }
+        }
+        else if (strncmp(args[argIdx], "--height=", 9) == 0)
+        {
+            options->targetHeight = atoi(&args[argIdx][9]);
+            if (options->targetHeight < 1)
+            {
+                printf("Error: Incorrect value for the target height.\n");
+                return false;
+            }
+        }
+        else if (strncmp(args[argIdx], "--seam-order=", 13) == 0)
+        {
+            int seamOrder = -1;
+            for (int o = 0; o < SEAM_ORDER_COUNT; o++)
+            {
+                if (strcmp(&args[argIdx][13], seamOrderNames[o]) == 0) seamOrder = o;
+            }
+
+            if (seamOrder < 0)
+            {
+                printf("Error: Unknown seam order %s.\n", &args[argIdx][13]);
+                return false;
+            }
+            options->seamOrder = (SeamOrder) seamOrder;
+        }
+        else if (strncmp(args[argIdx], "--seam-block=", 13) == 0)
+        {
+            options->seamBlock = atoi(&args[argIdx][13]);
+            if (options->seamBlock < 1)
+            {
+                printf("Error: Incorrect value for the seam block.\n");
+                return false;
+            }
+        }
+        else if (strncmp(args[argIdx], "--seam-map-out=", 15) == 0)
+        {
+            options->seamMapOut = &args[argIdx][15];
+        }
+        else if (strncmp(args[argIdx], "--seam-map-in=", 14) == 0)
+        {
+            options->seamMapIn = &args[argIdx][14];
+        }
+        else
+        {
+            printf("Error: Unknown argument %s.\n", args[argIdx]);
+            return false;
+        }
+    }
+
+    // Only the multi engine removes more than one seam per pass
+    if (options->engine != ENGINE_MULTI && options->seamsPerPass > 1)
+    {
+        printf("Error: --seams-per-pass needs --engine=multi.\n");
+        return false;
+    }
+    // Only the default and the incremental engine can run without an energy plane
+    if (options->streamingEnergy && options->engine != ENGINE_DEFAULT && options->engine != ENGINE_INCREMENTAL)
+    {
+        printf("Error: --streaming-energy needs --engine=default or --engine=incremental.\n");
+        return false;
+    }
+    // The forward cost depends on the direction, only the direction map of the rolling engine can backtrack it
+    if (options->energyFunction == ENERGY_FORWARD && options->engine != ENGINE_ROLLING)
+    {
+        printf("Error: --energy=forward needs --engine=rolling.\n");
+        return false;
+    }
+    // The transport map compares the seam energy of the steps, which streaming energy doesn't sum
+    if (options->seamOrder == SEAM_ORDER_OPTIMAL && options->streamingEnergy)
+    {
+        printf("Error: --seam-order=optimal doesn't work with --streaming-energy.\n");
+        return false;
+    }
+    // A seam order map numbers the vertical seams of the source image, the optimal order carves into copies that
+    // don't compact the source columns
+    if ((options->seamMapOut != NULL || options->seamMapIn != NULL) && options->targetHeight > 0)
+    {
+        printf("Error: --seam-map-out and --seam-map-in only work with vertical seams (no --height).\n");
+        return false;
+    }
+    if (options->seamMapOut != NULL && options->seamOrder == SEAM_ORDER_OPTIMAL)
+    {
+        printf("Error: --seam-map-out doesn't work with --seam-order=optimal.\n");
+        return false;
+    }
+    if (options->seamMapOut != NULL && options->seamMapIn != NULL)
+    {
+        printf("Error: --seam-map-out and --seam-map-in can't be combined.\n");
+        return false;
+    }
+    if (options->seamsPerPass == 0)
+    {
+        options->seamsPerPass = options->engine == ENGINE_MULTI ? MULTI_SEAMS_PER_PASS_DEFAULT : 1;
+    }
+
+    return true;
+}
+
+// SERVICE ///////////////////////////////////////////////////////////////////////////////
+#ifdef __unix__
+
+/// @brief Free a cache entry (it's no longer in the cache and no request uses it)
+static void cachedImageFree(CachedImage* entry)
+{
+    omp_destroy_lock(&entry->lock);
+    free(entry->path);
+    stbi_image_free(entry->img);
+    free(entry->imgEnergy[0]);
+    free(entry->imgEnergy[1]);
+    for (int mapIdx = 0; mapIdx < entry->seamMapCount; mapIdx++)
+    {
+        free(entry->seamMaps[mapIdx]->seamOrderMap);
+        free(entry->seamMaps[mapIdx]);
+    }
+    free(entry);
+}
+
+/// @brief Release an acquired cache entry
+static void imageCacheRelease(ImageCache* cache, CachedImage* entry)
+{
+    omp_set_lock(&cache->lock);
+    bool unused = --entry->references == 0 && entry->evicted;
+    omp_unset_lock(&cache->lock);
+    if (unused) cachedImageFree(entry);
+}
+
+/// @brief Get the cache entry of an image (the least recently used entries are evicted), returns NULL if the image
+/// can't be loaded, every acquired entry has to be released
+static CachedImage* imageCacheAcquire(ImageCache* cache, const char* path, bool* hit)
+{
+    CachedImage* entry = NULL;
+    CachedImage* evicted = NULL;
+    omp_set_lock(&cache->lock);
+    for (int entryIdx = 0; entryIdx < cache->entryCount && entry == NULL; entryIdx++)
+    {
+        if (strcmp(cache->entries[entryIdx]->path, path) == 0) entry = cache->entries[entryIdx];
+    }
+    *hit = entry != NULL;
+
+    // A miss puts the entry into the cache before decoding, locked until the image is decoded, so concurrent requests
+    // of the same image wait for this one decode instead of decoding it again
+    if (entry == NULL)
+    {
+        entry = (CachedImage *) calloc(1, sizeof(CachedImage));
+        entry->path = strdup(path);
+        omp_init_lock(&entry->lock);
+        omp_set_lock(&entry->lock);
+
+        if (cache->entryCount == cache->capacity)
+        {
+            int lruIdx = 0;
+            for (int entryIdx = 1; entryIdx < cache->entryCount; entryIdx++)
+            {
+                if (cache->entries[entryIdx]->lastUse < cache->entries[lruIdx]->lastUse) lruIdx = entryIdx;
+            }
+            cache->entries[lruIdx]->evicted = true;
+            if (cache->entries[lruIdx]->references == 0) evicted = cache->entries[lruIdx];
+            cache->entries[lruIdx] = cache->entries[--cache->entryCount];
+        }
+        cache->entries[cache->entryCount++] = entry;
+    }
+    entry->references++;
+    entry->lastUse = ++cache->useCounter;
+    omp_unset_lock(&cache->lock);
+    if (evicted != NULL) cachedImageFree(evicted);
+
+    if (*hit)
+    {
+        // Wait until the request that missed decoded the image
+        omp_set_lock(&entry->lock);
+        omp_unset_lock(&entry->lock);
+    }
+    else
+    {
+        // Decode outside the cache lock, the other workers keep serving from the cache
+        entry->img = stbi_load(path, &entry->width, &entry->height, &entry->channelCount, STB_COLOR_CHANNELS);
+        if (entry->img == NULL)
+        {
+            // The waiting requests fail as well, the next request of the path tries again
+            omp_set_lock(&cache->lock);
+            for (int entryIdx = 0; entryIdx < cache->entryCount; entryIdx++)
+            {
+                if (cache->entries[entryIdx] == entry) cache->entries[entryIdx] = cache->entries[--cache->entryCount];
+            }
+            entry->evicted = true;
+            omp_unset_lock(&cache->lock);
+        }
+        omp_unset_lock(&entry->lock);
+    }
+
+    if (entry->img == NULL)
+    {
+        imageCacheRelease(cache, entry);
+        return NULL;
+    }
+    return entry;
+}
+
+/// @brief A seam order map can serve a request if it was recorded with the same engine and energy source
+static inline bool seamMapMatches(const ProcessOptions* mapOptions, const ProcessOptions* options)
+{
+    return mapOptions->engine == options->engine && mapOptions->seamsPerPass == options->seamsPerPass &&
+           mapOptions->streamingEnergy == options->streamingEnergy && mapOptions->luminance == options->luminance;
+}
+
+/// @brief Take a seam order map out of its entry, it's freed once no request applies it (entry lock held)
+static void cachedSeamMapDrop(CachedSeamMap* map)
+{
+    map->replaced = true;
+    if (map->references == 0)
+    {
+        free(map->seamOrderMap);
+        free(map);
+    }
+}
+
+/// @brief Find a seam order map of the entry with the options and at least seamCount seams, returns NULL if there is
+/// none, an acquired map stays valid (even if another request replaces it) until it's released
+static CachedSeamMap* cachedSeamMapAcquire(CachedImage* entry, const ProcessOptions* options, int seamCount)
+{
+    CachedSeamMap* map = NULL;
+    omp_set_lock(&entry->lock);
+    for (int mapIdx = 0; mapIdx < entry->seamMapCount && map == NULL; mapIdx++)
+    {
+        CachedSeamMap* candidate = entry->seamMaps[mapIdx];
+        if (seamCount <= candidate->seamCount && seamMapMatches(&candidate->options, options)) map = candidate;
+    }
+    if (map != NULL)
+    {
+        map->references++;
+        map->lastUse = ++entry->mapUseCounter;
+    }
+    omp_unset_lock(&entry->lock);
+    return map;
+}
+
+/// @brief Release an acquired seam order map
+static void cachedSeamMapRelease(CachedImage* entry, CachedSeamMap* map)
+{
+    omp_set_lock(&entry->lock);
+    map->references--;
+    if (map->replaced) cachedSeamMapDrop(map);
+    omp_unset_lock(&entry->lock);
+}
+
+/// @brief Keep a recorded seam order map in the entry, it replaces the map of the same options if that one has fewer
+/// seams (or else the least recently used map of a full entry), returns false if the map isn't kept
+static bool cachedSeamMapStore(CachedImage* entry, const ProcessOptions* options, unsigned short* seamOrderMap, int seamCount)
+{
+    omp_set_lock(&entry->lock);
+    int slotIdx = -1;
+    for (int mapIdx = 0; mapIdx < entry->seamMapCount; mapIdx++)
+    {
+        if (seamMapMatches(&entry->seamMaps[mapIdx]->options, options)) slotIdx = mapIdx;
+    }
+
+    const bool stored = slotIdx < 0 || entry->seamMaps[slotIdx]->seamCount < seamCount;
+    if (stored)
+    {
+        if (slotIdx < 0 && entry->seamMapCount < SERVE_CACHE_MAPS)
+        {
+            slotIdx = entry->seamMapCount++;
+        }
+        else
+        {
+            if (slotIdx < 0)
+            {
+                slotIdx = 0;
+                for (int mapIdx = 1; mapIdx < entry->seamMapCount; mapIdx++)
+                {
+                    if (entry->seamMaps[mapIdx]->lastUse < entry->seamMaps[slotIdx]->lastUse) slotIdx = mapIdx;
+                }
+            }
+            cachedSeamMapDrop(entry->seamMaps[slotIdx]);
+        }
+
+        CachedSeamMap* map = (CachedSeamMap *) calloc(1, sizeof(CachedSeamMap));
+        map->seamOrderMap = seamOrderMap;
+        map->seamCount = seamCount;
+        map->options = *options;
+        map->lastUse = ++entry->mapUseCounter;
+        entry->seamMaps[slotIdx] = map;
+    }
+    omp_unset_lock(&entry->lock);
+    return stored;
+}
+
+/// @brief Serve one resize request (the command line arguments without the seam count, separated by spaces):
+/// <imageInPath> <imageOutPath> [--width=<w>] [--height=<h>] [--engine=<name>] ..., writes the response line
+static bool serveResize(char* request, ImageCache* cache, ServiceStats* stats, EnergyFunction energyFunction, char* response, size_t responseSize)
+{
+    double startTime = omp_get_wtime();
+
+    char* args[SERVE_REQUEST_ARGS];
+    char seamCountArg[] = "0";
+    int argc = 1;
+    char* savePtr = NULL;
+    for (char* token = strtok_r(request, " \t\r\n", &savePtr); token != NULL && argc < SERVE_REQUEST_ARGS; token = strtok_r(NULL, " \t\r\n", &savePtr))
+    {
+        // The seam count argument of the command line is left out (the sizes are given with --width and --height)
+        if (argc == 3) args[argc++] = seamCountArg;
+        args[argc++] = token;
+    }
+    args[0] = "request";
+    if (argc == 3) args[argc++] = seamCountArg;
+
+    ProcessOptions options;
+    if (argc < 4 || !parseOptions(argc, args, &options))
+    {
+        snprintf(response, responseSize, "ERROR invalid request\n");
+        return false;
+    }
+    // The pixel energy kernels are selected once for the whole service, the service records its own seam order maps
+    if (options.energyFunction != energyFunction || options.seamMapOut != NULL || options.seamMapIn != NULL)
+    {
+        snprintf(response, responseSize, "ERROR the service runs with --energy=%s and no --seam-map-out or --seam-map-in\n", energyFunctionNames[energyFunction]);
+        return false;
+    }
+
+    bool imageHit;
+    CachedImage* entry = imageCacheAcquire(cache, args[1], &imageHit);
+    if (entry == NULL)
+    {
+        snprintf(response, responseSize, "ERROR couldn't load image %s\n", args[1]);
+        return false;
+    }
+
+    int seamCount = options.targetWidth > 0 ? entry->width - options.targetWidth : 0;
+    int horizontalSeamCount = options.targetHeight > 0 ? entry->height - options.targetHeight : 0;
+    if (seamCount < 0 || horizontalSeamCount < 0)
+    {
+        snprintf(response, responseSize, "ERROR the target size is larger than the %dx%d image\n", entry->width, entry->height);
+        imageCacheRelease(cache, entry);
+        return false;
+    }
+
+    ImageProcessData data = {0};
+    data.img = (unsigned char *) malloc(sizeof(unsigned char) * entry->width * entry->height * entry->channelCount);
+    memcpy(data.img, entry->img, sizeof(unsigned char) * entry->width * entry->height * entry->channelCount);
+    data.width = entry->width;
+    data.height = entry->height;
+    data.stride = entry->width;
+    data.channelCount = entry->channelCount;
+    TimingStats timingStats = {0};
+
+    // Vertical seams only: one filtering pass if a cached seam order map of the options has enough seams (applied
+    // outside the entry lock, the other requests of the image don't wait for it)
+    const bool verticalOnly = seamCount > 0 && horizontalSeamCount == 0;
+    bool mapHit = false;
+    if (verticalOnly)
+    {
+        CachedSeamMap* map = cachedSeamMapAcquire(entry, &options, seamCount);
+        if (map != NULL)
+        {
+            seamOrderMapApply(&data, map->seamOrderMap, seamCount);
+            cachedSeamMapRelease(entry, map);
+            mapHit = true;
+        }
+    }
+
+    // Carve, the energy plane of the source comes from the cache if the first seams are vertical
+    const bool energySeeded = !mapHit && seamCount > 0 && !options.streamingEnergy && options.energyFunction != ENERGY_FORWARD &&
+                              options.seamOrder != SEAM_ORDER_HORIZONTAL_FIRST && options.seamOrder != SEAM_ORDER_OPTIMAL;
+    bool energyHit = false;
+    if (!mapHit)
+    {
+        const bool recordMap = verticalOnly && options.seamOrder != SEAM_ORDER_OPTIMAL;
+        if (recordMap)
+        {
+            seamOrderMapInit(&data);
+        }
+
+        if (energySeeded)
+        {
+            const size_t energySize = sizeof(EnergyValue) * data.width * data.height;
+            if (options.luminance)
+            {
+                calculateLuminance(&data);
+            }
+            // A cached plane is never replaced (every request of the energy source calculates the same one), so it's
+            // copied outside the entry lock
+            omp_set_lock(&entry->lock);
+            const EnergyValue* cachedEnergy = entry->imgEnergy[options.luminance];
+            omp_unset_lock(&entry->lock);
+            energyHit = cachedEnergy != NULL;
+            if (energyHit)
+            {
+                data.imgEnergy = (EnergyValue *) malloc(energySize);
+                memcpy(data.imgEnergy, cachedEnergy, energySize);
+            }
+            else
+            {
+                calculateEnergyFull(&data);
+                EnergyValue* imgEnergy = (EnergyValue *) malloc(energySize);
+                memcpy(imgEnergy, data.imgEnergy, energySize);
+                omp_set_lock(&entry->lock);
+                if (entry->imgEnergy[options.luminance] == NULL)
+                {
+                    entry->imgEnergy[options.luminance] = imgEnergy;
+                    imgEnergy = NULL;
+                }
+                omp_unset_lock(&entry->lock);
+                free(imgEnergy);
+            }
+            data.energyCurrent = true;
+        }
+
+        carveImage(&data, seamCount, horizontalSeamCount, &options, &timingStats);
+
+        // Keep the map for the next requests with the same options (the one with the most seams)
+        if (recordMap && cachedSeamMapStore(entry, &options, data.seamOrderMap, seamCount))
+        {
+            data.seamOrderMap = NULL;
+        }
+    }
+    imageCacheRelease(cache, entry);
+    double processingTime = omp_get_wtime() - startTime;
+
+    bool written = stbi_write_png(args[2], data.width, data.height, data.channelCount, data.img, data.stride * data.channelCount) != 0;
+    const int outputWidth = data.width;
+    const int outputHeight = data.height;
+    processDataFreeBuffers(&data);
+    free(data.pixelColumns);
+    free(data.seamOrderMap);
+    free(data.img);
+    if (!written)
+    {
+        snprintf(response, responseSize, "ERROR couldn't write image %s\n", args[2]);
+        return false;
+    }
+
+    // The latency includes decoding (on a miss) and encoding the PNG, the processing time stops before encoding
+    double latency = omp_get_wtime() - startTime;
+    const char* imageState = imageHit ? "hit" : "miss";
+    const char* energyState = !energySeeded ? "none" : energyHit ? "hit" : "miss";
+    const char* mapState = !verticalOnly ? "none" : mapHit ? "hit" : "miss";
+    #pragma omp critical(serviceStats)
+    {
+        stats->imageHits += imageHit;
+        stats->imageMisses += !imageHit;
+        stats->energyHits += energySeeded && energyHit;
+        stats->energyMisses += energySeeded && !energyHit;
+        stats->mapHits += verticalOnly && mapHit;
+        stats->mapMisses += verticalOnly && !mapHit;
+        stats->totalLatency += latency;
+        stats->maxLatency = max(stats->maxLatency, latency);
+        stats->totalProcessingTime += processingTime;
+    }
+
+    snprintf(response, responseSize, "OK %dx%d latency=%fs processing=%fs image=%s energy=%s map=%s\n",
+             outputWidth, outputHeight, latency, processingTime, imageState, energyState, mapState);
+    printf("Request %s -> %s: %dx%d in %fs, processing %fs (image %s, energy %s, map %s)\n",
+           args[1], args[2], outputWidth, outputHeight, latency, processingTime, imageState, energyState, mapState);
+    return true;
+}
+
+/// @brief Write the service stats (hit rates of the cache and request latency) as one line
+static void serveStats(ServiceStats* stats, char* response, size_t responseSize)
+{
+    #pragma omp critical(serviceStats)
+    {
+        unsigned long long served = stats->requests - stats->errors;
+        snprintf(response, responseSize,
+                 "STATS requests=%llu errors=%llu image_hit_rate=%f energy_hit_rate=%f map_hit_rate=%f mean_latency=%fs max_latency=%fs mean_processing=%fs\n",
+                 stats->requests, stats->errors,
+                 stats->imageHits + stats->imageMisses > 0 ? (double) stats->imageHits / (stats->imageHits + stats->imageMisses) : 0,
+                 stats->energyHits + stats->energyMisses > 0 ? (double) stats->energyHits / (stats->energyHits + stats->energyMisses) : 0,
+                 stats->mapHits + stats->mapMisses > 0 ? (double) stats->mapHits / (stats->mapHits + stats->mapMisses) : 0,
+                 served > 0 ? stats->totalLatency / served : 0, stats->maxLatency,
+                 served > 0 ? stats->totalProcessingTime / served : 0);
+    }
+}
+
+/// @brief Run the resize service on a Unix domain socket: --serve=<socketPath> [--workers=<n>] [--cache=<n>]
+/// [--energy=<name>], every connection sends one request line and gets one response line, STATS returns the hit rates
+/// and latencies, SHUTDOWN stops the service
+int serveMain(int argc, char *args[])
+{
+    const char* socketPath = &args[1][8];
+    int workers = SERVE_WORKERS_DEFAULT;
+    int cacheCapacity = SERVE_CACHE_DEFAULT;
+    EnergyFunction energyFunction = ENERGY_SOBEL;
+    for (int argIdx = 2; argIdx < argc; argIdx++)
+    {
+        if (strncmp(args[argIdx], "--workers=", 10) == 0)
+        {
+            workers = atoi(&args[argIdx][10]);
+        }
+        else if (strncmp(args[argIdx], "--cache=", 8) == 0)
+        {
+            cacheCapacity = atoi(&args[argIdx][8]);
+        }
+        else if (strncmp(args[argIdx], "--energy=", 9) == 0)
+        {
+            int function = -1;
+            for (int f = 0; f < ENERGY_FUNCTION_COUNT; f++)
+            {
+                if (strcmp(&args[argIdx][9], energyFunctionNames[f]) == 0) function = f;
+            }
+            if (function < 0)
+            {
+                printf("Error: Unknown energy function %s.\n", &args[argIdx][9]);
+                return EXIT_FAILURE;
+            }
+            energyFunction = (EnergyFunction) function;
+        }
+        else
+        {
+            printf("Error: Unknown argument %s.\n", args[argIdx]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (workers < 1 || cacheCapacity < 1)
+    {
+        printf("Error: Incorrect value for the workers or the cache size.\n");
+        return EXIT_FAILURE;
+    }
+
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    unlink(socketPath);
+    if (listenSocket < 0 || bind(listenSocket, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listenSocket, workers * 4) != 0)
+    {
+        printf("Error: Couldn't listen on %s\n", socketPath);
+        return EXIT_FAILURE;
+    }
+    // A client that hangs up before its response must not stop the service
+    signal(SIGPIPE, SIG_IGN);
+
+    // The pixel energy kernels are global, the generic one handles every channel count (the images of the requests differ)
+    seamKernelsInit();
+    seamKernelsSelectEnergy(energyFunction);
+    pixelEnergyKernelInit(0, energyFunction);
+
+    ImageCache cache = {0};
+    cache.entries = (CachedImage **) malloc(sizeof(CachedImage *) * cacheCapacity);
+    cache.capacity = cacheCapacity;
+    omp_init_lock(&cache.lock);
+    ServiceStats stats = {0};
+    bool shutdownRequested = false;
+
+    printf("Serving on %s with %d workers and %d cached images.\n", socketPath, workers, cacheCapacity);
+    fflush(stdout);
+
+    /// Parallel:
+    // - the workers are an OpenMP team, every worker accepts the next connection itself (no dispatcher thread)
+    // - the engines' parallel regions are nested in the worker, with the default single active level every request runs
+    //   on one thread (throughput over latency), --workers=1 gives one request at a time all threads
+    // - SHUTDOWN shuts the listening socket down, which wakes the other workers from accept
+    #pragma omp parallel num_threads(workers)
+    {
+        char request[SERVE_REQUEST_LENGTH];
+        char response[SERVE_REQUEST_LENGTH];
+        while (true)
+        {
+            int client = accept(listenSocket, NULL, NULL);
+            if (client < 0)
+            {
+                bool stop;
+                #pragma omp atomic read
+                stop = shutdownRequested;
+                if (stop) break;
+
+                // Out of descriptors or memory: wait for requests to finish instead of spinning on accept, an aborted
+                // connection or a signal only fails this accept, any other error stops the service
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                {
+                    usleep(SERVE_ACCEPT_BACKOFF);
+                }
+                else if (errno != EINTR && errno != ECONNABORTED && errno != EPROTO)
+                {
+                    printf("Error: Couldn't accept connections (%s).\n", strerror(errno));
+                    #pragma omp atomic write
+                    shutdownRequested = true;
+                    shutdown(listenSocket, SHUT_RDWR);
+                    break;
+                }
+                continue;
+            }
+
+            // One request line per connection
+            int length = 0;
+            int received;
+            while (length < SERVE_REQUEST_LENGTH - 1 && (received = read(client, &request[length], SERVE_REQUEST_LENGTH - 1 - length)) > 0)
+            {
+                length += received;
+                if (memchr(&request[length - received], '\n', received) != NULL) break;
+            }
+            request[length] = '\0';
+
+            if (strncmp(request, "STATS", 5) == 0)
+            {
+                serveStats(&stats, response, sizeof(response));
+            }
+            else if (strncmp(request, "SHUTDOWN", 8) == 0)
+            {
+                #pragma omp atomic write
+                shutdownRequested = true;
+                shutdown(listenSocket, SHUT_RDWR);
+                snprintf(response, sizeof(response), "OK shutdown\n");
+            }
+            else
+            {
+                bool served = serveResize(request, &cache, &stats, energyFunction, response, sizeof(response));
+                #pragma omp critical(serviceStats)
+                {
+                    stats.requests++;
+                    stats.errors += !served;
+                }
+            }
+
+            if (write(client, response, strlen(response)) < 0)
+            {
+                printf("Error: Couldn't answer a request.\n");
+            }
+            close(client);
+        }
+    }
+
+    char response[SERVE_REQUEST_LENGTH];
+    serveStats(&stats, response, sizeof(response));
+    printf("%s", response);
+
+    close(listenSocket);
+    unlink(socketPath);
+    for (int entryIdx = 0; entryIdx < cache.entryCount; entryIdx++)
+    {
+        cachedImageFree(cache.entries[entryIdx]);
+    }
+    free(cache.entries);
+    omp_destroy_lock(&cache.lock);
+    return EXIT_SUCCESS;
+}
+#endif
+
+int main(int argc, char *args[])
+{
+#ifdef __unix__
+    if (argc >= 2 && strncmp(args[1], "--serve=", 8) == 0)
+    {
+        return serveMain(argc, args);
+    }
+#endif
+
+    // Read arguments
+    if (argc < 4)
+    {
+        printf("Error: Invalid amount of arguments. [%d]\n", argc);
+        exit(EXIT_FAILURE);
+    }
+    printf("Arguments: imageInPath=%s, imageOutPath=%s, seamCount=%s\n", args[1], args[2], args[3]);
+
+    // Parse arguments /////////////////////////////////////////////////////////////////////
+    char *imageInPath = args[1];
+    char *imageOutPath = args[2];
+    int seamCount = atoi(args[3]);  // Vertical seams (--width overrides it)
+    int horizontalSeamCount;        // From --height (0 keeps the height)
+    int outputHeight;
+
+    ProcessOptions options;
+    if (!parseOptions(argc, args, &options))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    // Setup processing data struct //////////////////////////////////////////////////////
+    ImageProcessData processData;
+    processData.img = NULL;
+    processData.imgLuminance = NULL;
+    processData.imgEnergy = NULL;
+    processData.imgSeam = NULL;
+    processData.seamDirections = NULL;
+    processData.seamTransfers = NULL;
+    processData.seamPath = NULL;
+    processData.seamCount = 0;
+    processData.seamEnergy = 0;
+    processData.energyCurrent = false;
+    processData.pixelColumns = NULL;
+    processData.seamOrderMap = NULL;
+
+    // Load image //////////////////////////////////////////////////////////////////////////
     processData.img = stbi_load(imageInPath, &processData.width, &processData.height, &processData.channelCount, STB_COLOR_CHANNELS);
     if (processData.img == NULL)
     {
@@ -450,62 +3324,91 @@ int main(int argc, char *args[])
         exit(EXIT_FAILURE);
     }
     printf("Loaded image %s of size %dx%d.\n", imageInPath, processData.width, processData.height);
+    processData.stride = processData.width;
+    pixelEnergyKernelInit(processData.channelCount, options.energyFunction);
 
-    if (seamCount >= processData.width || seamCount < 0)
+    if (options.targetWidth > 0)
+    {
+        seamCount = processData.width - options.targetWidth;
+    }
+    if (seamCount >= processData.width || (options.seamMapOut != NULL && seamCount >= SEAM_ORDER_KEPT))
     {
         printf("Error: Incorrect value for number of seams.\n");
         return EXIT_FAILURE;
     }
-    outputHeight = processData.height;
+    // A negative seam count (or a larger --width) inserts seams, they are found with a recorded seam order map
+    if (seamCount < 0 && (processData.width < 2 || options.seamOrder == SEAM_ORDER_OPTIMAL ||
+                          options.seamMapOut != NULL || options.seamMapIn != NULL))
+    {
+        printf("Error: Seam insertion needs a width of at least 2 and doesn't work with --seam-order=optimal, --seam-map-out or --seam-map-in.\n");
+        return EXIT_FAILURE;
+    }
+    outputHeight = options.targetHeight > 0 ? options.targetHeight : processData.height;
+    horizontalSeamCount = processData.height - outputHeight;
+    if (horizontalSeamCount < 0)
+    {
+        printf("Error: Incorrect value for the target height.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Select SIMD kernels //////////////////////////////////////////////////////////////////////
+    seamKernelsInit();
+    seamKernelsSelectEnergy(options.energyFunction);
 
     // Process image //////////////////////////////////////////////////////////////////////////
     TimingStats timingStats = {0};
     timingStats.cpus = omp_get_max_threads() / 2;
 
-    double startTotalProcessingTime = omp_get_wtime();
-    // printf("Seam count: %d\n", seamCount);
-
-    double startEnergyTime = omp_get_wtime();
-    calculateEnergyFull(&processData);
-    double stopEnergyTime = omp_get_wtime();
-    timingStats.energyCalculations += stopEnergyTime - startEnergyTime;
-    for (int i = 0; i < seamCount; i++)
+    // A seam order map replaces the carving with one filtering pass
+    unsigned short* seamOrderMap = NULL;
+    if (options.seamMapIn != NULL)
     {
-        // printf("Processing seam %d/%d\n", i + 1, seamCount);
-
-        // Energy step
-        startEnergyTime = omp_get_wtime();
-        if (i != 0) {
-            updateEnergyOnSeam(&processData);
+        int mapSeamCount = 0;
+        seamOrderMap = readSeamOrderMap(options.seamMapIn, processData.width, processData.height, &mapSeamCount);
+        if (seamOrderMap == NULL)
+        {
+            printf("Error: Couldn't load the seam order map %s for a %dx%d image.\n", options.seamMapIn, processData.width, processData.height);
+            return EXIT_FAILURE;
         }
-        stopEnergyTime = omp_get_wtime();
-        timingStats.energyCalculations += stopEnergyTime - startEnergyTime;
-
-        // Seam identification step
-        double startSeamTime = omp_get_wtime();
-        seamIdentification(&processData);
-        double stopSeamTime = omp_get_wtime();
-        timingStats.seamIdentifications += stopSeamTime - startSeamTime;
+        if (seamCount > mapSeamCount)
+        {
+            printf("Error: The seam order map only has %d seams.\n", mapSeamCount);
+            return EXIT_FAILURE;
+        }
+    }
+    if (options.seamMapOut != NULL)
+    {
+        seamOrderMapInit(&processData);
+    }
 
-        // Seam annotate step
-        double startAnnotateTime = omp_get_wtime();
-        seamAnnotate(&processData);
-        double stopAnnotateTime = omp_get_wtime();
-        timingStats.seamAnnotates += stopAnnotateTime - startAnnotateTime;
+    double startTotalProcessingTime = omp_get_wtime();
+    // printf("Seam count: %d\n", seamCount);
 
-        // Seam remove step
+    if (seamOrderMap != NULL)
+    {
         double startSeamRemoveTime = omp_get_wtime();
-        seamRemove(&processData);
+        seamOrderMapApply(&processData, seamOrderMap, seamCount);
         double stopSeamRemoveTime = omp_get_wtime();
         timingStats.seamRemoves += stopSeamRemoveTime - startSeamRemoveTime;
-
-#ifdef RENDER_LOADING_BAR_WIDTH
-        updatePrintLoadingBar(i + 1, seamCount);
-#endif
+    }
+    else
+    {
+        carveImage(&processData, seamCount, horizontalSeamCount, &options, &timingStats);
     }
     double stopTotalProcessingTime = omp_get_wtime();
     timingStats.totalProcessingTime = stopTotalProcessingTime - startTotalProcessingTime;
 
+    // Output seam order map //////////////////////////////////////////////////////////////////////////
+    if (options.seamMapOut != NULL)
+    {
+        if (!writeSeamOrderMap(options.seamMapOut, processData.seamOrderMap, processData.stride, processData.height, seamCount))
+        {
+            printf("Error: Couldn't write the seam order map %s\n", options.seamMapOut);
+            return EXIT_FAILURE;
+        }
+        printf("Output seam order map %s of %d seams.\n", options.seamMapOut, seamCount);
+    }
+
     // Output debug image //////////////////////////////////////////////////////////////////////////
 #ifdef SAVE_DEBUG_IMAGE
     char debugImageOutPath[100];
@@ -513,10 +3416,21 @@ int main(int argc, char *args[])
     outputDebugImage(&processData, debugImageOutPath);
 #endif
 
+    // Compare with the exact result (not timed) //////////////////////////////////////////////////////////////
+    DriftStats drift = {0};
+    const bool driftMeasured = (options.engine == ENGINE_MULTI || options.luminance) && options.seamMapIn == NULL &&
+                               measureDrift(&processData, imageInPath, seamCount, horizontalSeamCount, &options, &drift);
+
     // Free process data //////////////////////////////////////////////////////////////////////////
     free(processData.seamPath);
     free(processData.imgSeam);
+    free(processData.seamDirections);
+    free(processData.seamTransfers);
     free(processData.imgEnergy);
+    free(processData.imgLuminance);
+    free(processData.pixelColumns);
+    free(processData.seamOrderMap);
+    free(seamOrderMap);
 
     // Output image //////////////////////////////////////////////////////////////////////////
     stbi_write_png(imageOutPath,
@@ -524,7 +3438,7 @@ int main(int argc, char *args[])
                    processData.height,
                    processData.channelCount,
                    processData.img,
-                   processData.width * processData.channelCount);
+                   processData.stride * processData.channelCount);
 
     printf("Output image %s of size %dx%d.\n", imageOutPath, processData.width, processData.height);
 
@@ -533,11 +3447,30 @@ int main(int argc, char *args[])
     // Output timing stats //////////////////////////////////////////////////////////////////////////
     printf("--------------- Timing Stats ---------------\n");
     printf("CPUs: %d\n", timingStats.cpus);
+    printf("SIMD Kernels: %s\n", simdTierNames[seamKernels.tier]);
+    printf("Engine: %s\n", carvingEngineNames[options.engine]);
+    printf("Seams per Pass: %d\n", options.seamsPerPass);
+    printf("Energy Plane: %s\n", options.streamingEnergy ? "streaming" : "stored");
+    printf("Energy Bits: %d\n", (int) (8 * sizeof(EnergyValue)));
+    printf("Energy Source: %s\n", options.luminance ? "luminance" : "channels");
+    printf("Energy Function: %s\n", energyFunctionNames[options.energyFunction]);
+    printf("Horizontal Seams: %d\n", horizontalSeamCount);
+    printf("Seam Order: %s\n", seamOrderNames[options.seamOrder]);
+    printf("Seam Map: %s\n", options.seamMapIn != NULL ? "applied" : options.seamMapOut != NULL ? "recorded" : "none");
     printf("Total Processing Time: %fs\n", timingStats.totalProcessingTime);
     printf("Energy Calculations: %fs [%f %%]\n", timingStats.energyCalculations, timingStats.energyCalculations / timingStats.totalProcessingTime * 100);
     printf("Seam Identifications: %fs [%f %%]\n", timingStats.seamIdentifications, timingStats.seamIdentifications / timingStats.totalProcessingTime * 100);
     printf("Seam Annotates: %fs [%f %%]\n", timingStats.seamAnnotates, timingStats.seamAnnotates / timingStats.totalProcessingTime * 100);
     printf("Seam Removes: %fs [%f %%]\n", timingStats.seamRemoves, timingStats.seamRemoves / timingStats.totalProcessingTime * 100);
+    printf("Seam Inserts: %fs [%f %%]\n", timingStats.seamInserts, timingStats.seamInserts / timingStats.totalProcessingTime * 100);
+    printf("Transposes: %fs [%f %%]\n", timingStats.transposes, timingStats.transposes / timingStats.totalProcessingTime * 100);
+    if (driftMeasured)
+    {
+        printf("--------------- Drift from Exact ---------------\n");
+        printf("Seam Energy: %llu (exact %llu) [%+f %%]\n", drift.seamEnergy, drift.exactSeamEnergy, drift.seamEnergyIncrease * 100);
+        printf("Changed Pixels: %f %%\n", drift.changedPixels * 100);
+        printf("Mean Absolute Error: %f\n", drift.meanAbsoluteError);
+    }
 
     // Output timing stats to file //////////////////////////////////////////////////////////////////////////
 #ifdef SAVE_TIMING_STATS
@@ -545,6 +3478,16 @@ int main(int argc, char *args[])
     fprintf(timingFile, "--------------- PARALLEL SEAM CARVING ---------------\n", imageInPath);
     fprintf(timingFile, "--------------- %s ---------------\n", imageInPath);
     fprintf(timingFile, "CPUs: %d\n", timingStats.cpus);
+    fprintf(timingFile, "SIMD Kernels: %s\n", simdTierNames[seamKernels.tier]);
+    fprintf(timingFile, "Engine: %s\n", carvingEngineNames[options.engine]);
+    fprintf(timingFile, "Seams per Pass: %d\n", options.seamsPerPass);
+    fprintf(timingFile, "Energy Plane: %s\n", options.streamingEnergy ? "streaming" : "stored");
+    fprintf(timingFile, "Energy Bits: %d\n", (int) (8 * sizeof(EnergyValue)));
+    fprintf(timingFile, "Energy Source: %s\n", options.luminance ? "luminance" : "channels");
+    fprintf(timingFile, "Energy Function: %s\n", energyFunctionNames[options.energyFunction]);
+    fprintf(timingFile, "Horizontal Seams: %d\n", horizontalSeamCount);
+    fprintf(timingFile, "Seam Order: %s\n", seamOrderNames[options.seamOrder]);
+    fprintf(timingFile, "Seam Map: %s\n", options.seamMapIn != NULL ? "applied" : options.seamMapOut != NULL ? "recorded" : "none");
     fprintf(timingFile, "Arguments: imageInPath=%s, imageOutPath=%s, seamCount=%s\n", args[1], args[2], args[3]);
     fprintf(timingFile, "--------------- Timing Stats ---------------\n");
     fprintf(timingFile, "Total Processing Time: %fs\n", timingStats.totalProcessingTime);
@@ -552,6 +3495,15 @@ int main(int argc, char *args[])
     fprintf(timingFile, "Seam Identifications: %fs [%f %%]\n", timingStats.seamIdentifications, timingStats.seamIdentifications / timingStats.totalProcessingTime * 100);
     fprintf(timingFile, "Seam Annotates: %fs [%f %%]\n", timingStats.seamAnnotates, timingStats.seamAnnotates / timingStats.totalProcessingTime * 100);
     fprintf(timingFile, "Seam Removes: %fs [%f %%]\n", timingStats.seamRemoves, timingStats.seamRemoves / timingStats.totalProcessingTime * 100);
+    fprintf(timingFile, "Seam Inserts: %fs [%f %%]\n", timingStats.seamInserts, timingStats.seamInserts / timingStats.totalProcessingTime * 100);
+    fprintf(timingFile, "Transposes: %fs [%f %%]\n", timingStats.transposes, timingStats.transposes / timingStats.totalProcessingTime * 100);
+    if (driftMeasured)
+    {
+        fprintf(timingFile, "--------------- Drift from Exact ---------------\n");
+        fprintf(timingFile, "Seam Energy: %llu (exact %llu) [%+f %%]\n", drift.seamEnergy, drift.exactSeamEnergy, drift.seamEnergyIncrease * 100);
+        fprintf(timingFile, "Changed Pixels: %f %%\n", drift.changedPixels * 100);
+        fprintf(timingFile, "Mean Absolute Error: %f\n", drift.meanAbsoluteError);
+    }
     fprintf(timingFile, "\n");
     fclose(timingFile);
 #endif
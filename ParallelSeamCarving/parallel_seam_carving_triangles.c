@@ -7,6 +7,8 @@
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <sched.h>
 
 // IMPORTED LIBS //////////////////////////////////////////////////////////////////////////
 #define STB_IMAGE_IMPLEMENTATION
@@ -14,6 +16,9 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "lib/stb_image_write.h"
 
+// KERNELS ////////////////////////////////////////////////////////////////////////////////
+#include "seam_carving_kernels.h"
+
 // MACROS ////////////////////////////////////////////////////////////////////////////////
 #define max(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -32,6 +37,7 @@
 #define ENERGY_CHANNEL_COUNT 1
 #define UNDEFINED_UINT UINT_MAX
 #define STRIP_HEIGHT 15 // Keep the STRIP_HEIGHT odd
+#define TILE_SPIN_LIMIT 1024 // Pause iterations before a thread waiting on a tile yields its core
 
 // USER DEFINES ////////////////////////////////////////////////////////////////////////////
 #define SAVE_TIMING_STATS
@@ -48,9 +54,24 @@ typedef struct __ImageProcessData__
     int* seamPath;
     int width;
     int height;
+    int stride;  // Pixels per row of img and imgEnergy (the original width, rows are compacted in place)
     int channelCount;
 } ImageProcessData;
 
+typedef enum __CarvingEngine__
+{
+    ENGINE_BARRIER,   // Up triangles, barrier, down triangles, barrier (per strip)
+    ENGINE_DATAFLOW,  // Point-to-point dependencies between the triangle tiles
+    ENGINE_COUNT
+} CarvingEngine;
+
+static const char* carvingEngineNames[ENGINE_COUNT] = { "barrier", "dataflow" };
+
+typedef struct __ProcessOptions__
+{
+    CarvingEngine engine;
+} ProcessOptions;
+
 typedef struct __TimingStats__
 {
     double totalProcessingTime;
@@ -92,8 +113,8 @@ static inline unsigned char *getPixel(unsigned char *data, int x, int y, int wid
     return &data[pixelIdx];
 }
 
-/// @brief Get the pixel data at the given position (with bounds check)
-static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int width, int height, int channelCount)  // Only used for energy calculation
+/// @brief Get the pixel data at the given position (with bounds check, rows are stride pixels apart)
+static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount)  // Only used for energy calculation
 {
     // if x and y outside bounds, use the closest pixel
     if (x < 0)       x = 0;
@@ -101,7 +122,7 @@ static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int wi
     if (x >= width)  x = width - 1;
     if (y >= height) y = height - 1;
 
-    return getPixel(data, x, y, width, height, channelCount);
+    return getPixel(data, x, y, stride, height, channelCount);
 }
 
 /// @brief Get the energy pixel data at the given position
@@ -139,29 +160,30 @@ static inline bool isSeam(ImageProcessData* data, int x, int y)
 }
 
 /// @brief Calculate the energy of a pixel using the sobel operator
-static inline unsigned int calculatePixelEnergy(unsigned char *data, int x, int y, int width, int height, int channelCount)
+static inline unsigned int calculatePixelEnergy(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount)
 {
+    const int energyChannelCount = getEnergyChannelCount(channelCount);  // Alpha takes no part in the energy
     int energy = 0;
-    for (int rgbChannel = 0; rgbChannel < channelCount; rgbChannel++)
+    for (int rgbChannel = 0; rgbChannel < energyChannelCount; rgbChannel++)
     {
-        int Gx = -     getPixelE(data, x - 1, y - 1, width, height, channelCount)[rgbChannel]
-                 - 2 * getPixelE(data, x - 1,     y, width, height, channelCount)[rgbChannel]
-                 -     getPixelE(data, x - 1, y + 1, width, height, channelCount)[rgbChannel]
-                 +     getPixelE(data, x + 1, y - 1, width, height, channelCount)[rgbChannel]
-                 + 2 * getPixelE(data, x + 1,     y, width, height, channelCount)[rgbChannel]
-                 +     getPixelE(data, x + 1, y + 1, width, height, channelCount)[rgbChannel];
-
-        int Gy = +     getPixelE(data, x - 1, y - 1, width, height, channelCount)[rgbChannel]
-                 + 2 * getPixelE(data,     x, y - 1, width, height, channelCount)[rgbChannel]
-                 +     getPixelE(data, x + 1, y - 1, width, height, channelCount)[rgbChannel]
-                 -     getPixelE(data, x - 1, y + 1, width, height, channelCount)[rgbChannel]
-                 - 2 * getPixelE(data,     x, y + 1, width, height, channelCount)[rgbChannel]
-                 -     getPixelE(data, x + 1, y + 1, width, height, channelCount)[rgbChannel];
+        int Gx = -     getPixelE(data, x - 1, y - 1, width, height, stride, channelCount)[rgbChannel]
+                 - 2 * getPixelE(data, x - 1,     y, width, height, stride, channelCount)[rgbChannel]
+                 -     getPixelE(data, x - 1, y + 1, width, height, stride, channelCount)[rgbChannel]
+                 +     getPixelE(data, x + 1, y - 1, width, height, stride, channelCount)[rgbChannel]
+                 + 2 * getPixelE(data, x + 1,     y, width, height, stride, channelCount)[rgbChannel]
+                 +     getPixelE(data, x + 1, y + 1, width, height, stride, channelCount)[rgbChannel];
+
+        int Gy = +     getPixelE(data, x - 1, y - 1, width, height, stride, channelCount)[rgbChannel]
+                 + 2 * getPixelE(data,     x, y - 1, width, height, stride, channelCount)[rgbChannel]
+                 +     getPixelE(data, x + 1, y - 1, width, height, stride, channelCount)[rgbChannel]
+                 -     getPixelE(data, x - 1, y + 1, width, height, stride, channelCount)[rgbChannel]
+                 - 2 * getPixelE(data,     x, y + 1, width, height, stride, channelCount)[rgbChannel]
+                 -     getPixelE(data, x + 1, y + 1, width, height, stride, channelCount)[rgbChannel];
 
         energy += sqrt(pow(Gx, 2) + pow(Gy, 2));
     }
 
-    return energy / channelCount;
+    return energy / energyChannelCount;
 }
 
 #ifdef SAVE_DEBUG_IMAGE
@@ -187,7 +209,7 @@ void outputDebugImage(ImageProcessData* processData, char* imageOutPath)
             }
             else
             {
-                unsigned int pixelPos = getPixelIdx(x, y, debugWidth);
+                unsigned int pixelPos = getPixelIdx(x, y, processData->stride);
                 pixel[0] = processData->imgEnergy[pixelPos];
                 pixel[1] = processData->imgEnergy[pixelPos];
                 pixel[2] = processData->imgEnergy[pixelPos];
@@ -211,20 +233,55 @@ static inline void calculateEnergyFull(ImageProcessData* data)
     }
 
     // Allocate space for energy and calculate energy for each pixel
-    data->imgEnergy = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
+    data->imgEnergy = (unsigned int *) malloc(sizeof(unsigned int) * data->stride * data->height);
 
     /// Parallel:
     // - Tested looping with one for loop through all data but is consistently slower in parallel and in sequential.
     // - Tested collapse(2) but also seems to be slower.
     // - Standard approach is probably the best, as each thread gets a couple of rows (as cache lines) and every pixel calculation is independent
+    // - Each row is computed by the widest SIMD energy kernel the CPU supports, on a padded copy of the image
+    //   so no pixel needs a bounds check (see seam_carving_kernels.h)
+    PaddedImage padded;
+    paddedImageAlloc(&padded, data->width, data->height, data->channelCount);
+
     #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int x = 0; x < data->width; x++)
+        paddedImageFillRow(&padded, data->img, data->stride, y);
+    }
+    paddedImageFillBorderRows(&padded);
+
+    #pragma omp parallel for
+    for (int y = 0; y < data->height; y++)
+    {
+        seamKernels.energyRow(&padded, &data->imgEnergy[getPixelIdx(0, y, data->stride)], y);
+    }
+
+    paddedImageFree(&padded);
+}
+
+/// @brief Update the energy of one row in place after the seam was removed (img and width are already the new ones)
+static inline void updateEnergyOnSeamRowInPlace(ImageProcessData* data, int y)
+{
+    unsigned int* energyRow = &data->imgEnergy[getPixelIdx(0, y, data->stride)];
+
+    // Get data.
+    int seamX0 = y > 0 ? data->seamPath[y - 1] : data->seamPath[y];
+    int seamX1 = data->seamPath[y];
+    int seamX2 = y < data->height - 1 ? data->seamPath[y + 1] : data->seamPath[y];
+
+    // Move the energy right of the seam one pixel to the left
+    seamCompactRow(energyRow, &seamX1, 1, data->width + 1, sizeof(unsigned int));
+
+    // Recalculate the pixels that were next to the seam in the old image (oldX within 1 of the seam in rows y - 1, y, y + 1)
+    int xStart = max(min(min(seamX0, seamX1), seamX2) - 2, 0);
+    int xEnd = min(max(max(seamX0, seamX1), seamX2) + 1, data->width - 1);
+    for (int x = xStart; x <= xEnd; x++)
+    {
+        int oldX = x + (x >= seamX1);
+        if (abs(oldX - seamX0) <= 1 || abs(oldX - seamX1) <= 1 || abs(oldX - seamX2) <= 1)
         {
-            unsigned int pixelIdx = getPixelIdx(x, y, data->width);
-            unsigned int energy = calculatePixelEnergy(data->img, x, y, data->width, data->height, data->channelCount);
-            data->imgEnergy[pixelIdx] = energy;
+            energyRow[x] = calculatePixelEnergy(data->img, x, y, data->width, data->height, data->stride, data->channelCount);
         }
     }
 }
@@ -232,67 +289,84 @@ static inline void calculateEnergyFull(ImageProcessData* data)
 /// @brief Update the energy of the pixels on the seam instead of updating the whole energy image
 void updateEnergyOnSeam(ImageProcessData* data)
 {
-    unsigned int *imgEnergyNew = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
-
-    int oldWidth = data->width + 1;
-
+    /// Parallel:
+    // - rows keep their fixed stride, so compacting and recalculating row y only writes row y (reads of img rows
+    //   y - 1 and y + 1 see the already compacted image), every row is independent
     #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int x = 0; x < oldWidth; x++)
-        {
-            // Get data.
-            int seamX0 = y > 0 ? data->seamPath[y - 1] : INT_MAX;
-            int seamX1 = data->seamPath[y];
-            int seamX2 = y < data->height - 1 ? data->seamPath[y + 1] : INT_MAX;
-
-            int insertOffsetX = -(x > seamX1);
-            int idx = getPixelIdx(x + insertOffsetX, y, data->width);
-
-            // Should recalculate.
-            int difX0 = abs(x - seamX0);
-            int difX1 = abs(x - seamX1);
-            int difX2 = abs(x - seamX2);
-            bool shouldRecalculate = difX0 <= 1 || difX1 <= 1 || difX2 <= 1;
-
-            // Recalculate and/or insert.
-            if (shouldRecalculate)
-            {
-                int newX, newY;
-                getPixelPos(idx, data->width, &newX, &newY);
-                imgEnergyNew[idx] = calculatePixelEnergy(data->img, newX, newY, data->width, data->height, data->channelCount);
-            }
-            else
-            {
-                imgEnergyNew[idx] = data->imgEnergy[getPixelIdx(x, y, oldWidth)];
-            }
-        }
+        updateEnergyOnSeamRowInPlace(data, y);
     }
+}
 
-    free(data->imgEnergy);
 
-    data->imgEnergy = imgEnergyNew;
+/// @brief Calculate one up pointing triangle of the strip (widest row at the bottom of the strip)
+static inline void triangleUp(ImageProcessData* data, int stripBottom, int triangleIdx)
+{
+    const int triangleWidth = STRIP_HEIGHT * 2;
+    for (int yLocal = 0; yLocal < STRIP_HEIGHT; yLocal++)
+    {
+        int y = stripBottom - yLocal;
+        if (y < 0) break;
+
+        int xStart = triangleIdx * triangleWidth + yLocal;
+        int xEnd = min(xStart + triangleWidth - 2 * yLocal, data->width);
+        seamKernels.dpRow(getSeamRow(data->imgSeam, y + 1, data->width),
+                          &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                          getSeamRow(data->imgSeam, y, data->width),
+                          xStart, xEnd);
+    }
 }
 
-
-/// @brief Calculate the cumulative energy of the image from the bottom to the top using the triangle approach to parallelization
-void triangleSeamIdentification(ImageProcessData* data)
+/// @brief Calculate one down pointing triangle of the strip (bottom triangles start off the image to the left)
+static inline void triangleDown(ImageProcessData* data, int stripBottom, int triangleIdx)
 {
-    if (data->imgSeam != NULL) {
-        free(data->imgSeam);
+    const int triangleWidth = STRIP_HEIGHT * 2;
+    const int bottomPointTriangleLeftStartX = -STRIP_HEIGHT;
+    for (int yLocal = 0; yLocal < STRIP_HEIGHT; yLocal++)
+    {
+        int y = stripBottom - yLocal;
+        if (y < 0) break;
+
+        int invYLocal = STRIP_HEIGHT - yLocal - 1;  // Inverted yLocal as the triangle is pointing down
+        int xStart = bottomPointTriangleLeftStartX + triangleIdx * triangleWidth + invYLocal;
+        int xEnd = min(xStart + triangleWidth - 2 * invYLocal, data->width);
+        int clampedXStart = max(0, xStart);
+        seamKernels.dpRow(getSeamRow(data->imgSeam, y + 1, data->width),
+                          &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                          getSeamRow(data->imgSeam, y, data->width),
+                          clampedXStart, xEnd);
     }
+}
 
-    data->imgSeam = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
+/// @brief Prepare the cumulative energy for the current width and fill its bottom row with the energy values
+/// (the plane is allocated once for the original width, only the guard columns move as the image narrows)
+static inline void triangleSeamInit(ImageProcessData* data)
+{
+    if (data->imgSeam == NULL)
+    {
+        data->imgSeam = seamPlaneAlloc(data->stride, data->height);
+    }
 
-    // Fill bottom row with energy values
-    for (int x = 0; x < data->width; x++)
+    for (int y = 0; y < data->height; y++)
     {
-        data->imgSeam[getPixelIdx(x, data->height - 1, data->width)] = getEnergyPixelE(data->imgEnergy, x, data->height - 1, data->width, data->height);
+        seamRowSetGuards(getSeamRow(data->imgSeam, y, data->width), data->width);
     }
 
+    // Fill bottom row with energy values
+    memcpy(getSeamRow(data->imgSeam, data->height - 1, data->width),
+           &data->imgEnergy[getPixelIdx(0, data->height - 1, data->stride)],
+           sizeof(unsigned int) * data->width);
+}
+
+/// @brief Calculate the cumulative energy of the image from the bottom to the top using the triangle approach to parallelization
+void triangleSeamIdentification(ImageProcessData* data)
+{
+    triangleSeamInit(data);
+
     // Separate steps by horizontal STRIPS of height STRIP_HEIGHT
     // (skip the bottom row as it is already correct)
-    for (int stripBottom = data->height - 2; stripBottom > 0; stripBottom -= STRIP_HEIGHT)
+    for (int stripBottom = data->height - 2; stripBottom >= 0; stripBottom -= STRIP_HEIGHT)
     {
         int triangleWidth = STRIP_HEIGHT * 2;
         int triangleCount = (data->width + triangleWidth - 1) / triangleWidth;
@@ -301,75 +375,107 @@ void triangleSeamIdentification(ImageProcessData* data)
         #pragma omp parallel for
         for (int triangleIdx = 0; triangleIdx < triangleCount; triangleIdx++)
         {
-            for (int yLocal = 0; yLocal < STRIP_HEIGHT; yLocal++)
-            {
-                int y = stripBottom - yLocal;
-                if (y < 0) break;
-
-                int xStart = triangleIdx * triangleWidth + yLocal;
-                int xEnd = min(xStart + triangleWidth - 2 * yLocal, data->width);
-                for (int x = xStart; x < xEnd; x++)
-                {
-                    unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, x - 1, y + 1, data->width, data->height);
-                    unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, x    , y + 1, data->width, data->height);
-                    unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, x + 1, y + 1, data->width, data->height);
-
-                    unsigned int curEnergy = getEnergyPixelE(data->imgEnergy, x, y, data->width, data->height);
-                    unsigned int minEnergy = min(leftEnergy, min(centerEnergy, rightEnergy));
-
-                    data->imgSeam[getPixelIdx(x, y, data->width)] = curEnergy + minEnergy;
-                }
-            }
+            triangleUp(data, stripBottom, triangleIdx);
         }
 
 
         // Calculate each down pointing triangle in the strip
         // (bottom triangles start off the image to the left)
-        int bottomPointTriangleLeftStartX = -STRIP_HEIGHT;
-        triangleCount = (-bottomPointTriangleLeftStartX + data->width + triangleWidth - 1) / triangleWidth;
+        triangleCount = (STRIP_HEIGHT + data->width + triangleWidth - 1) / triangleWidth;
         #pragma omp parallel for
         for (int triangleIdx = 0; triangleIdx < triangleCount; triangleIdx++)
         {
-            for (int yLocal = 0; yLocal < STRIP_HEIGHT; yLocal++)
+            triangleDown(data, stripBottom, triangleIdx);
+        }
+    }
+}
+
+/// @brief Spin until the tile column has finished the given number of strips
+// (yields the core after a while, in case there are more threads than cores)
+static inline void waitTileDone(atomic_int* tileDone, int stripCount)
+{
+    int spinCount = 0;
+    while (atomic_load_explicit(tileDone, memory_order_acquire) < stripCount)
+    {
+        if (++spinCount < TILE_SPIN_LIMIT)
+            _mm_pause();
+        else
+            sched_yield();
+    }
+}
+
+/// @brief Calculate the cumulative energy with the triangle tiles, each tile only waits for the tiles it reads from
+void triangleSeamIdentificationDataflow(ImageProcessData* data)
+{
+    triangleSeamInit(data);
+
+    const int triangleWidth = STRIP_HEIGHT * 2;
+    const int upCount = (data->width + triangleWidth - 1) / triangleWidth;
+    const int downCount = (STRIP_HEIGHT + data->width + triangleWidth - 1) / triangleWidth;
+    const int stripCount = (data->height - 2 + STRIP_HEIGHT) / STRIP_HEIGHT;
+
+    // Number of finished strips of each up/down triangle column
+    atomic_int* upDone = (atomic_int *) calloc(upCount, sizeof(atomic_int));
+    atomic_int* downDone = (atomic_int *) calloc(downCount, sizeof(atomic_int));
+
+    /// Parallel:
+    // - no barrier between the up and down triangles or between strips, the dependencies are point-to-point:
+    //   - up triangle t of strip s reads the top row of strip s - 1 from down triangles t and t + 1
+    //   - down triangle t of strip s reads the up triangles t - 1 and t of the same strip
+    // - each thread owns a fixed block of triangle columns for all strips, so it only ever waits on the
+    //   two neighbouring threads and a thread at the image edge runs ahead as far as its neighbour allows
+    #pragma omp parallel
+    {
+        int upStart, upEnd;
+        getThreadRange(upCount, 1, omp_get_thread_num(), omp_get_num_threads(), &upStart, &upEnd);
+
+        // Down triangles go with the up triangle on their right, the last block also takes the ones past the image
+        int downStart = upStart;
+        int downEnd = upEnd == upCount && upStart < upEnd ? downCount : upEnd;
+
+        for (int strip = 0; strip < stripCount; strip++)
+        {
+            int stripBottom = data->height - 2 - strip * STRIP_HEIGHT;
+
+            for (int triangleIdx = upStart; triangleIdx < upEnd; triangleIdx++)
             {
-                int y = stripBottom - yLocal;
-                if (y < 0) break;
-
-                int invYLocal = STRIP_HEIGHT - yLocal - 1;  // Inverted yLocal as the triangle is pointing down
-                int xStart = bottomPointTriangleLeftStartX + triangleIdx * triangleWidth + invYLocal;
-                int xEnd = min(xStart + triangleWidth - 2 * invYLocal, data->width);
-                int clampedXStart = max(0, xStart);
-                for (int x = clampedXStart; x < xEnd; x++)
-                {
-                    unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, x - 1, y + 1, data->width, data->height);
-                    unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, x    , y + 1, data->width, data->height);
-                    unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, x + 1, y + 1, data->width, data->height);
-
-                    unsigned int curEnergy = getEnergyPixelE(data->imgEnergy, x, y, data->width, data->height);
-                    unsigned int minEnergy = min(leftEnergy, min(centerEnergy, rightEnergy));
-
-                    data->imgSeam[getPixelIdx(x, y, data->width)] = curEnergy + minEnergy;
-                }
+                waitTileDone(&downDone[triangleIdx], strip);
+                if (triangleIdx + 1 < downCount) waitTileDone(&downDone[triangleIdx + 1], strip);
+
+                triangleUp(data, stripBottom, triangleIdx);
+                atomic_store_explicit(&upDone[triangleIdx], strip + 1, memory_order_release);
+            }
+
+            for (int triangleIdx = downStart; triangleIdx < downEnd; triangleIdx++)
+            {
+                if (triangleIdx > 0)       waitTileDone(&upDone[triangleIdx - 1], strip + 1);
+                if (triangleIdx < upCount) waitTileDone(&upDone[triangleIdx], strip + 1);
+
+                triangleDown(data, stripBottom, triangleIdx);
+                atomic_store_explicit(&downDone[triangleIdx], strip + 1, memory_order_release);
             }
         }
     }
+
+    free(upDone);
+    free(downDone);
 }
 
 /// @brief Annotate the seam in the image (with SEAM value)
 void seamAnnotate(ImageProcessData* data)
 {
-    // Allocate memory for seam path
-    if (data->seamPath != NULL)
+    // Allocate memory for seam path (once, the height never changes)
+    if (data->seamPath == NULL)
     {
-        free(data->seamPath);
+        data->seamPath = (int *) malloc(sizeof(int) * data->height);
     }
-    data->seamPath = (int *) malloc(sizeof(int) * data->height);
 
     // Find the minimum energy in the top row
+    const unsigned int* seamRowTop = getSeamRow(data->imgSeam, 0, data->width);
     int curX = 0;
     for (int x = 1; x < data->width; x++)
     {
-        if (data->imgSeam[getPixelIdx(x, 0, data->width)] < data->imgSeam[getPixelIdx(curX, 0, data->width)])
+        if (seamRowTop[x] < seamRowTop[curX])
         {
             curX = x;
         }
@@ -380,10 +486,11 @@ void seamAnnotate(ImageProcessData* data)
 
     for (int y = 0; y < data->height - 1; y++)
     {
-        // Find the minimum energy in the next row
-        unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, curX - 1, y + 1, data->width, data->height);
-        unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, curX    , y + 1, data->width, data->height);
-        unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, curX + 1, y + 1, data->width, data->height);
+        // Find the minimum energy in the next row (guard columns hold INT_MAX at the image edges)
+        const unsigned int* seamRowBelow = getSeamRow(data->imgSeam, y + 1, data->width);
+        unsigned int leftEnergy =   seamRowBelow[curX - 1];
+        unsigned int centerEnergy = seamRowBelow[curX    ];
+        unsigned int rightEnergy =  seamRowBelow[curX + 1];
 
         // Select next X
         if (leftEnergy < centerEnergy && leftEnergy < rightEnergy)
@@ -403,39 +510,18 @@ void seamAnnotate(ImageProcessData* data)
 /// @brief Remove the seam from the image
 void seamRemove(ImageProcessData* processData)
 {
-    // Allocate space for new image
-    unsigned int newWidth = processData->width - 1;
-    unsigned int pixelCount = newWidth * processData->height;
-    unsigned char* image = (unsigned char *) malloc(sizeof(unsigned char) * pixelCount * processData->channelCount);
-
-    // Copy image data without seam
+    // Compact the image in place (rows keep their stride, only the pixels right of the seam move)
     /// Parallel:
-    // - standard for parallel, as the copying of whole lines is nicely devided between threads
+    // - standard for parallel, as the rows are nicely devided between threads and each row only touches itself
+    // - only the tail of each row after the seam is moved (memmove), nothing is allocated or copied whole
     #pragma omp parallel for
     for (int y = 0; y < processData->height; y++)
     {
-        int seanPassed = false;  // Did we pass the sean?
-        for (int x = 0; x < processData->width; x++)
-        {
-            if (!isSeam(processData, x, y))
-            {
-                unsigned int pixelIdxC = getPixelIdxC(x, y, processData->width, processData->channelCount);
-                for (int channel = 0; channel < processData->channelCount; channel++)
-                {
-                    unsigned int pixelPos = getPixelIdxC(x - seanPassed, y, newWidth, processData->channelCount);
-                    image[pixelPos + channel] = processData->img[pixelIdxC + channel];
-                }
-            }
-            else
-                seanPassed = true;
-        }
+        seamCompactRow(&processData->img[getPixelIdxC(0, y, processData->stride, processData->channelCount)],
+                       &processData->seamPath[y], 1, processData->width, processData->channelCount);
     }
 
-    // Free old image and set new image
-    free(processData->img);
-
     // Update process data
-    processData->img = image;
     processData->width = processData->width - 1;
     processData->height = processData->height;
     processData->channelCount = processData->channelCount;
@@ -463,10 +549,42 @@ void updatePrintLoadingBar(int progress, int total)
 }
 #endif
 
+/// @brief Parse the optional arguments after the seam count (--engine=<name>)
+bool parseOptions(int argc, char *args[], ProcessOptions* options)
+{
+    options->engine = ENGINE_DATAFLOW;
+
+    for (int argIdx = 4; argIdx < argc; argIdx++)
+    {
+        if (strncmp(args[argIdx], "--engine=", 9) == 0)
+        {
+            int engine = -1;
+            for (int e = 0; e < ENGINE_COUNT; e++)
+            {
+                if (strcmp(&args[argIdx][9], carvingEngineNames[e]) == 0) engine = e;
+            }
+
+            if (engine < 0)
+            {
+                printf("Error: Unknown engine %s.\n", &args[argIdx][9]);
+                return false;
+            }
+            options->engine = (CarvingEngine) engine;
+        }
+        else
+        {
+            printf("Error: Unknown argument %s.\n", args[argIdx]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int main(int argc, char *args[])
 {
     // Read arguments
-    if (argc != 4)
+    if (argc < 4)
     {
         printf("Error: Invalid amount of arguments. [%d]\n", argc);
         exit(EXIT_FAILURE);
@@ -479,6 +597,12 @@ int main(int argc, char *args[])
     int seamCount = atoi(args[3]);
     int outputHeight; // = atoi(args[4]); // Height stays the same
 
+    ProcessOptions options;
+    if (!parseOptions(argc, args, &options))
+    {
+        exit(EXIT_FAILURE);
+    }
+
     // Setup processing data struct //////////////////////////////////////////////////////
     ImageProcessData processData;
     processData.img = NULL;
@@ -494,6 +618,7 @@ int main(int argc, char *args[])
         exit(EXIT_FAILURE);
     }
     printf("Loaded image %s of size %dx%d.\n", imageInPath, processData.width, processData.height);
+    processData.stride = processData.width;
 
     if (seamCount >= processData.width || seamCount < 0)
     {
@@ -502,6 +627,9 @@ int main(int argc, char *args[])
     }
     outputHeight = processData.height;
 
+    // Select SIMD kernels //////////////////////////////////////////////////////////////////////
+    seamKernelsInit();
+
     // Process image //////////////////////////////////////////////////////////////////////////
     TimingStats timingStats = {0};
     timingStats.cpus = omp_get_max_threads() / 2;
@@ -527,7 +655,10 @@ int main(int argc, char *args[])
 
         // Seam identification step
         double startSeamTime = omp_get_wtime();
-        triangleSeamIdentification(&processData);
+        if (options.engine == ENGINE_DATAFLOW)
+            triangleSeamIdentificationDataflow(&processData);
+        else
+            triangleSeamIdentification(&processData);
         double stopSeamTime = omp_get_wtime();
         timingStats.seamIdentifications += stopSeamTime - startSeamTime;
 
@@ -568,7 +699,7 @@ int main(int argc, char *args[])
                    processData.height,
                    processData.channelCount,
                    processData.img,
-                   processData.width * processData.channelCount);
+                   processData.stride * processData.channelCount);
 
     printf("Output image %s of size %dx%d.\n", imageOutPath, processData.width, processData.height);
 
@@ -577,6 +708,8 @@ int main(int argc, char *args[])
     // Output timing stats //////////////////////////////////////////////////////////////////////////
     printf("--------------- Timing Stats ---------------\n");
     printf("CPUs: %d\n", timingStats.cpus);
+    printf("SIMD Kernels: %s\n", simdTierNames[seamKernels.tier]);
+    printf("Engine: %s\n", carvingEngineNames[options.engine]);
     printf("Total Processing Time: %fs\n", timingStats.totalProcessingTime);
     printf("Energy Calculations: %fs [%f %%]\n", timingStats.energyCalculations, timingStats.energyCalculations / timingStats.totalProcessingTime * 100);
     printf("Seam Identifications: %fs [%f %%]\n", timingStats.seamIdentifications, timingStats.seamIdentifications / timingStats.totalProcessingTime * 100);
@@ -589,6 +722,8 @@ int main(int argc, char *args[])
     fprintf(timingFile, "--------------- PARALLEL SEAM CARVING TRIANGLES ---------------\n", imageInPath);
     fprintf(timingFile, "--------------- %s ---------------\n", imageInPath);
     fprintf(timingFile, "CPUs: %d\n", timingStats.cpus);
+    fprintf(timingFile, "SIMD Kernels: %s\n", simdTierNames[seamKernels.tier]);
+    fprintf(timingFile, "Engine: %s\n", carvingEngineNames[options.engine]);
     fprintf(timingFile, "Arguments: imageInPath=%s, imageOutPath=%s, seamCount=%s\n", args[1], args[2], args[3]);
     fprintf(timingFile, "--------------- Timing Stats ---------------\n");
     fprintf(timingFile, "Total Processing Time: %fs\n", timingStats.totalProcessingTime);
@@ -14,6 +14,9 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "lib/stb_image_write.h"
 
+// KERNELS ////////////////////////////////////////////////////////////////////////////////
+#include "seam_carving_kernels.h"
+
 // MACROS ////////////////////////////////////////////////////////////////////////////////
 #define max(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -31,8 +34,12 @@
 #define SEAM UINT_MAX - 1
 #define ENERGY_CHANNEL_COUNT 1
 #define UNDEFINED_UINT UINT_MAX
-#define SIM_NUM_SEAM_REMOVAL 8
+#define MAX_SEAMS_PER_PASS 256 // Upper bound of the seams removed simultaneously (one per thread by default)
+#define STRIP_MIN_WIDTH 4 // Narrowest strip a pass may use (narrow images get fewer seams per pass)
+#define STRIP_BORDER_SEARCH 4 // A strip border moves at most (strip width / STRIP_BORDER_SEARCH) columns
+#define STRIP_BORDER_ROW_STEP 4 // Every n-th row is summed when looking for a low-energy border column
 #define STRIP_HEIGHT 15 // Keep the STRIP_HEIGHT odd
+#define STRIP_HALO_DEFAULT 0 // Columns the strip-local DP looks past each side of its strip (--halo=<n>)
 
 // USER DEFINES ////////////////////////////////////////////////////////////////////////////
 #define SAVE_TIMING_STATS
@@ -50,9 +57,30 @@ typedef struct __ImageProcessData__
     int** seamPath;
     int width;
     int height;
+    int stride;  // Pixels per row of img and imgEnergy (the original width, rows are compacted in place)
     int channelCount;
+    int stripHalo;  // Halo columns of the strip-local DP (imgSeam then holds all strip planes side by side), < 0 for one global DP
+    int seamCount;  // Seams removed in the current pass (one per strip)
+    int seamsPerPass;  // Most strips any pass uses (the strip-local plane holds this many strips side by side)
+    int* stripBounds;  // seamCount + 1 strip borders of the current pass, stripBounds[0] = 0 and stripBounds[seamCount] = width
 } ImageProcessData;
 
+typedef enum __CarvingEngine__
+{
+    ENGINE_GLOBAL,      // One DP over the whole width, parallel inside each row
+    ENGINE_TRIANGLES,   // One DP over the whole width, parallel in triangle tiles
+    ENGINE_STRIP,       // One independent DP per strip (task per strip, no synchronization between strips)
+    ENGINE_COUNT
+} CarvingEngine;
+
+static const char* carvingEngineNames[ENGINE_COUNT] = { "global", "triangles", "strip" };
+
+typedef struct __ProcessOptions__
+{
+    CarvingEngine engine;
+    int stripHalo;
+} ProcessOptions;
+
 typedef struct __TimingStats__
 {
     double totalProcessingTime;
@@ -94,8 +122,8 @@ static inline unsigned char *getPixel(unsigned char *data, int x, int y, int wid
     return &data[pixelIdx];
 }
 
-/// @brief Get the pixel data at the given position (with bounds check)
-static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int width, int height, int channelCount, int limitLowX, int limitHighX)  // Only used for energy calculation
+/// @brief Get the pixel data at the given position (with bounds check, rows are stride pixels apart)
+static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int height, int stride, int channelCount, int limitLowX, int limitHighX)  // Only used for energy calculation
 {
     // if x and y outside bounds, use the closest pixel
     if (x < limitLowX)   x = limitLowX;
@@ -103,7 +131,7 @@ static inline unsigned char *getPixelE(unsigned char *data, int x, int y, int wi
     if (x >= limitHighX) x = limitHighX - 1;
     if (y >= height)     y = height - 1;
 
-    return getPixel(data, x, y, width, height, channelCount);
+    return getPixel(data, x, y, stride, height, channelCount);
 }
 
 /// @brief Get the energy pixel data at the given position
@@ -139,7 +167,7 @@ static inline unsigned int getEnergyPixelE(unsigned int* data, int x, int y, int
 /// @brief Returns true if the observed position with coordinates x and y is considered as part of seam
 static inline bool isSeam(ImageProcessData* data, int x, int y, int seamIdx)
 {
-    if (data->seamPath == NULL || y >= data->height || seamIdx >= SIM_NUM_SEAM_REMOVAL)
+    if (data->seamPath == NULL || y >= data->height || seamIdx >= data->seamCount)
     {
         return false;
     }
@@ -148,42 +176,43 @@ static inline bool isSeam(ImageProcessData* data, int x, int y, int seamIdx)
 }
 
 /// @brief Calculate the energy of a pixel using the sobel operator
-static inline unsigned int calculatePixelEnergyStripe(unsigned char *data, int x, int y, int width, int height, int channelCount, int limitLowX, int limitHighX)
+static inline unsigned int calculatePixelEnergyStripe(unsigned char *data, int x, int y, int height, int stride, int channelCount, int limitLowX, int limitHighX)
 {
+    const int energyChannelCount = getEnergyChannelCount(channelCount);  // Alpha takes no part in the energy
     int energyTotal = 0;
-    for (int rgbChannel = 0; rgbChannel < channelCount; rgbChannel++)
+    for (int rgbChannel = 0; rgbChannel < energyChannelCount; rgbChannel++)
     {
-        int Gx = -     getPixelE(data, x - 1, y - 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 - 2 * getPixelE(data, x - 1,     y, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 -     getPixelE(data, x - 1, y + 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 +     getPixelE(data, x + 1, y - 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 + 2 * getPixelE(data, x + 1,     y, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 +     getPixelE(data, x + 1, y + 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel];
-
-        int Gy = +     getPixelE(data, x - 1, y - 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 + 2 * getPixelE(data,     x, y - 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 +     getPixelE(data, x + 1, y - 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 -     getPixelE(data, x - 1, y + 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 - 2 * getPixelE(data,     x, y + 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel]
-                 -     getPixelE(data, x + 1, y + 1, width, height, channelCount, limitLowX, limitHighX)[rgbChannel];
+        int Gx = -     getPixelE(data, x - 1, y - 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 - 2 * getPixelE(data, x - 1,     y, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 -     getPixelE(data, x - 1, y + 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 +     getPixelE(data, x + 1, y - 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 + 2 * getPixelE(data, x + 1,     y, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 +     getPixelE(data, x + 1, y + 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel];
+
+        int Gy = +     getPixelE(data, x - 1, y - 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 + 2 * getPixelE(data,     x, y - 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 +     getPixelE(data, x + 1, y - 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 -     getPixelE(data, x - 1, y + 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 - 2 * getPixelE(data,     x, y + 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel]
+                 -     getPixelE(data, x + 1, y + 1, height, stride, channelCount, limitLowX, limitHighX)[rgbChannel];
 
         energyTotal += sqrt(pow(Gx, 2) + pow(Gy, 2));
     }
-    int energy = energy / channelCount;
+    int energy = energyTotal / energyChannelCount;
     return energy;
 }
 
 /// @brief Wrapper function without horizontal stripe limits
-static inline unsigned int calculatePixelEnergy(unsigned char *data, int x, int y, int width, int height, int channelCount)
+static inline unsigned int calculatePixelEnergy(unsigned char *data, int x, int y, int width, int height, int stride, int channelCount)
 {
-    return calculatePixelEnergyStripe(data, x, y, width, height, channelCount, 0, width);
+    return calculatePixelEnergyStripe(data, x, y, height, stride, channelCount, 0, width);
 }
 
 #ifdef SAVE_DEBUG_IMAGE
 /// @brief Output the debug image with the seam annotated and energy values
 void outputDebugImage(ImageProcessData* processData, char* imageOutPath)
 {
-    int debugWidth = processData->width + SIM_NUM_SEAM_REMOVAL;
+    int debugWidth = processData->width + processData->seamCount;
     int debugHeight = processData->height;
     int debugChannelCount = processData->channelCount;
     unsigned char *debugImgData = (unsigned char *) malloc(sizeof(unsigned char *) * debugWidth * debugHeight * debugChannelCount);
@@ -204,7 +233,7 @@ void outputDebugImage(ImageProcessData* processData, char* imageOutPath)
             }
             else
             {
-                unsigned int pixelPos = getPixelIdx(x, y, debugWidth);
+                unsigned int pixelPos = getPixelIdx(x, y, processData->stride);
                 pixel[0] = processData->imgEnergy[pixelPos];
                 pixel[1] = processData->imgEnergy[pixelPos];
                 pixel[2] = processData->imgEnergy[pixelPos];
@@ -228,161 +257,128 @@ static inline void calculateEnergyFull(ImageProcessData* data)
     }
 
     // Allocate space for energy and calculate energy for each pixel
-    data->imgEnergy = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
+    data->imgEnergy = (unsigned int *) malloc(sizeof(unsigned int) * data->stride * data->height);
 
     /// Parallel:
     // - Tested looping with one for loop through all data but is consistently slower in parallel and in sequential.
     // - Tested collapse(2) but also seems to be slower.
     // - Standard approach is probably the best, as each thread gets a couple of rows (as cache lines) and every pixel calculation is independent
+    // - Each row is computed by the widest SIMD energy kernel the CPU supports, on a padded copy of the image
+    //   so no pixel needs a bounds check (see seam_carving_kernels.h)
+    PaddedImage padded;
+    paddedImageAlloc(&padded, data->width, data->height, data->channelCount);
+
     #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int x = 0; x < data->width; x++)
-        {
-            unsigned int pixelIdx = getPixelIdx(x, y, data->width);
-            unsigned int energy = calculatePixelEnergy(data->img, x, y, data->width, data->height, data->channelCount);
-            data->imgEnergy[pixelIdx] = energy;
-        }
+        paddedImageFillRow(&padded, data->img, data->stride, y);
     }
-}
+    paddedImageFillBorderRows(&padded);
 
-/// @brief Update the energy of the pixels on the seam instead of updating the whole energy image
-void updateEnergyOnSeam(ImageProcessData* data)
-{
-    unsigned int *imgEnergyNew = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
-
-    int oldWidth = data->width + SIM_NUM_SEAM_REMOVAL;
-    const int stripWidth = oldWidth / SIM_NUM_SEAM_REMOVAL;
-
-    /// Parallel:
     #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int x = 0; x < oldWidth; x++)
-        {
-            int stripIdx = x / stripWidth;
-            int lowX = stripIdx * stripWidth;
-            int highX = lowX + stripWidth;
-            int seamPassedCount = 0;
+        seamKernels.energyRow(&padded, &data->imgEnergy[getPixelIdx(0, y, data->stride)], y);
+    }
+
+    paddedImageFree(&padded);
+}
 
-            // Get data.
-            int seamX0 = y > 0 ? data->seamPath[stripIdx][y - 1] : INT_MAX;
-            int seamX1 = data->seamPath[stripIdx][y];
-            int seamX2 = y < data->height - 1 ? data->seamPath[stripIdx][y + 1] : INT_MAX;
+/// @brief Update the energy of one row in place after the seams were removed (img and width are already the new ones)
+static inline void updateEnergyOnSeamRow(ImageProcessData* data, int y)
+{
+    unsigned int* energyRow = &data->imgEnergy[getPixelIdx(0, y, data->stride)];
+    const int oldWidth = data->width + data->seamCount;
 
-            int insertOffsetX = x > seamX1 ? stripIdx + 1 : stripIdx;  // Each time we pass seam, the offset ticks up
+    // Move the energy between the seams to the left (the seams are sorted, one per strip)
+    int seamX[MAX_SEAMS_PER_PASS];
+    for (int stripIdx = 0; stripIdx < data->seamCount; stripIdx++)
+    {
+        seamX[stripIdx] = data->seamPath[stripIdx][y];
+    }
+    seamCompactRow(energyRow, seamX, data->seamCount, oldWidth, sizeof(unsigned int));
 
-            int idx = getPixelIdx(x - insertOffsetX, y, data->width);
+    // Recalculate the pixels of each strip that were next to its seam in the old image (rows y - 1, y, y + 1)
+    // (stripBounds are still the ones of the pass that removed the seams)
+    for (int stripIdx = 0; stripIdx < data->seamCount; stripIdx++)
+    {
+        int lowX = data->stripBounds[stripIdx];
+        int highX = data->stripBounds[stripIdx + 1];
 
-            // Should recalculate.
-            int difX0 = abs(x - seamX0);
-            int difX1 = abs(x - seamX1);
-            int difX2 = abs(x - seamX2);
-            bool shouldRecalculate = difX0 <= 1 || difX1 <= 1 || difX2 <= 1;
+        // Get data.
+        int seamX0 = y > 0 ? data->seamPath[stripIdx][y - 1] : seamX[stripIdx];
+        int seamX1 = seamX[stripIdx];
+        int seamX2 = y < data->height - 1 ? data->seamPath[stripIdx][y + 1] : seamX[stripIdx];
 
-            // Recalculate and/or insert.
-            if (shouldRecalculate)
-            {
-                int newX, newY;
-                getPixelPos(idx, data->width, &newX, &newY);
-                imgEnergyNew[idx] = calculatePixelEnergyStripe(data->img, newX, newY, data->width, data->height, data->channelCount, lowX, highX);
-            }
-            else
+        int oldXStart = max(min(min(seamX0, seamX1), seamX2) - 1, lowX);
+        int oldXEnd = min(max(max(seamX0, seamX1), seamX2) + 1, highX - 1);
+        for (int oldX = oldXStart; oldX <= oldXEnd; oldX++)
+        {
+            if (oldX == seamX1)
             {
-                imgEnergyNew[idx] = data->imgEnergy[getPixelIdx(x, y, oldWidth)];
+                continue;
             }
+
+            // Every strip lost one column and shifted by stripIdx, so are the strip limits
+            int x = oldX - stripIdx - (oldX > seamX1);
+            energyRow[x] = calculatePixelEnergyStripe(data->img, x, y, data->height, data->stride, data->channelCount, lowX - stripIdx, highX - stripIdx - 1);
         }
     }
-
-    free(data->imgEnergy);
-
-    data->imgEnergy = imgEnergyNew;
 }
 
-void updateEnergyOnSeamUpgrade(ImageProcessData* data)
+/// @brief Update the energy of the pixels on the seams instead of updating the whole energy image
+void updateEnergyOnSeam(ImageProcessData* data)
 {
-    int oldWidth = data->width + SIM_NUM_SEAM_REMOVAL;
-    const int stripWidth = oldWidth / SIM_NUM_SEAM_REMOVAL;
-
     /// Parallel:
-    // TODO: The elements write into the same array. This causes problems as the energy on the right can get updated before the energy on the left.
-    // Have to probably loop through x first and synchronize on each step of x.
+    // - img and imgEnergy keep a fixed row stride, so compacting and recalculating row y only writes row y
+    //   (earlier the energy was compacted into the same buffer with a smaller stride, so a row could overwrite
+    //   the start of the next row before it was read)
+    // - img is already compacted when this runs, reading rows y - 1 and y + 1 is safe, every row is independent
     #pragma omp parallel for
     for (int y = 0; y < data->height; y++)
     {
-        for (int stripIdx = 0; stripIdx < SIM_NUM_SEAM_REMOVAL; stripIdx++)
-        {
-            for (int x = data->seamPath[stripIdx][y] - 2; x < oldWidth; x++)
-            {
-                int stripIdx = x / stripWidth;
-                int lowX = stripIdx * stripWidth;
-                int highX = lowX + stripWidth;
-                int seamPassedCount = 0;
-
-                // Get data.
-                int seamX0 = y > 0 ? data->seamPath[stripIdx][y - 1] : INT_MAX;
-                int seamX1 = data->seamPath[stripIdx][y];
-                int seamX2 = y < data->height - 1 ? data->seamPath[stripIdx][y + 1] : INT_MAX;
-
-                int insertOffsetX = x > seamX1 ? stripIdx + 1 : stripIdx;  // Each time we pass seam, the offset ticks up
-                int idx = getPixelIdx(x - insertOffsetX, y, data->width);
-
-                // Should recalculate.
-                int difX0 = abs(x - seamX0);
-                int difX1 = abs(x - seamX1);
-                int difX2 = abs(x - seamX2);
-                bool shouldRecalculate = difX0 <= 1 || difX1 <= 1 || difX2 <= 1;
-
-                // Recalculate and/or insert.
-                if (shouldRecalculate)
-                {
-                    int newX, newY;
-                    getPixelPos(idx, data->width, &newX, &newY);
-                    data->imgEnergy[idx] = calculatePixelEnergy(data->img, newX, newY, data->width, data->height, data->channelCount);
-                }
-                else
-                {
-                    data->imgEnergy[idx] = data->imgEnergy[getPixelIdx(x, y, oldWidth)];
-                }
-            }
-        }
+        updateEnergyOnSeamRow(data, y);
     }
 }
 
-/// @brief Calculate the cumulative energy of the image from the bottom to the top
-void seamIdentification(ImageProcessData* data)
+/// @brief Prepare the cumulative energy plane for the current width and fill its bottom row with energy values
+/// (the plane is allocated once for the original width, only the guard columns move as the image narrows)
+static inline void seamPlanePrepare(ImageProcessData* data)
 {
-    // Free if already allocated
-    if (data->imgSeam != NULL)
+    if (data->imgSeam == NULL)
     {
-        free(data->imgSeam);
+        data->imgSeam = seamPlaneAlloc(data->stride, data->height);
     }
 
-    // Allocate space for seam and calculate cumulative energy for each pixel
-    data->imgSeam = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
-
-    // Fill bottom row with energy values
-    #pragma omp parallel
-    for (int x = 0; x < data->width; x++)
+    for (int y = 0; y < data->height; y++)
     {
-        data->imgSeam[getPixelIdx(x, data->height - 1, data->width)] = getEnergyPixelE(data->imgEnergy, x, data->height - 1, data->width, data->height);
+        seamRowSetGuards(getSeamRow(data->imgSeam, y, data->width), data->width);
     }
 
+    memcpy(getSeamRow(data->imgSeam, data->height - 1, data->width),
+           &data->imgEnergy[getPixelIdx(0, data->height - 1, data->stride)],
+           sizeof(unsigned int) * data->width);
+}
+
+/// @brief Calculate the cumulative energy of the image from the bottom to the top
+void seamIdentification(ImageProcessData* data)
+{
+    // Reuse the seam plane and fill the bottom row with energy values
+    seamPlanePrepare(data);
+
     /// Parallel:
     // - each row has to be calculated before starting the next row, we can only parallelize calc of a row
+    // - each thread gets one contiguous range of the row and runs the DP row kernel of the selected SIMD tier on it
     for (int y = data->height - 2; y >= 0; y--)
     {
-        #pragma omp parallel for
-        for (int x = 0; x < data->width; x++)
+        #pragma omp parallel
         {
-            unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, x - 1, y + 1, data->width, data->height);
-            unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, x    , y + 1, data->width, data->height);
-            unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, x + 1, y + 1, data->width, data->height);
-
-            unsigned int curEnergy = getEnergyPixelE(data->imgEnergy, x, y, data->width, data->height);
-            unsigned int minEnergy = min(leftEnergy, min(centerEnergy, rightEnergy));
-
-            data->imgSeam[getPixelIdx(x, y, data->width)] = curEnergy + minEnergy;
+            int xStart, xEnd;
+            getThreadRange(data->width, THREAD_RANGE_ALIGN, omp_get_thread_num(), omp_get_num_threads(), &xStart, &xEnd);
+            seamKernels.dpRow(getSeamRow(data->imgSeam, y + 1, data->width),
+                              &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                              getSeamRow(data->imgSeam, y, data->width),
+                              xStart, xEnd);
         }
     }
 }
@@ -390,21 +386,12 @@ void seamIdentification(ImageProcessData* data)
 /// @brief Calculate the cumulative energy of the image from the bottom to the top using the triangle approach to parallelization
 void triangleSeamIdentification(ImageProcessData* data)
 {
-    if (data->imgSeam != NULL) {
-        free(data->imgSeam);
-    }
-
-    data->imgSeam = (unsigned int *) malloc(sizeof(unsigned int) * data->width * data->height);
-
-    // Fill bottom row with energy values
-    for (int x = 0; x < data->width; x++)
-    {
-        data->imgSeam[getPixelIdx(x, data->height - 1, data->width)] = getEnergyPixelE(data->imgEnergy, x, data->height - 1, data->width, data->height);
-    }
+    // Reuse the seam plane and fill the bottom row with energy values
+    seamPlanePrepare(data);
 
     // Separate steps by horizontal STRIPS of height STRIP_HEIGHT
     // (skip the bottom row as it is already correct)
-    for (int stripBottom = data->height - 2; stripBottom > 0; stripBottom -= STRIP_HEIGHT)
+    for (int stripBottom = data->height - 2; stripBottom >= 0; stripBottom -= STRIP_HEIGHT)
     {
         int triangleWidth = STRIP_HEIGHT * 2;
         int triangleCount = (data->width + triangleWidth - 1) / triangleWidth;
@@ -420,17 +407,10 @@ void triangleSeamIdentification(ImageProcessData* data)
 
                 int xStart = triangleIdx * triangleWidth + yLocal;
                 int xEnd = min(xStart + triangleWidth - 2 * yLocal, data->width);
-                for (int x = xStart; x < xEnd; x++)
-                {
-                    unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, x - 1, y + 1, data->width, data->height);
-                    unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, x    , y + 1, data->width, data->height);
-                    unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, x + 1, y + 1, data->width, data->height);
-
-                    unsigned int curEnergy = getEnergyPixelE(data->imgEnergy, x, y, data->width, data->height);
-                    unsigned int minEnergy = min(leftEnergy, min(centerEnergy, rightEnergy));
-
-                    data->imgSeam[getPixelIdx(x, y, data->width)] = curEnergy + minEnergy;
-                }
+                seamKernels.dpRow(getSeamRow(data->imgSeam, y + 1, data->width),
+                                  &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                  getSeamRow(data->imgSeam, y, data->width),
+                                  xStart, xEnd);
             }
         }
 
@@ -451,39 +431,154 @@ void triangleSeamIdentification(ImageProcessData* data)
                 int xStart = bottomPointTriangleLeftStartX + triangleIdx * triangleWidth + invYLocal;
                 int xEnd = min(xStart + triangleWidth - 2 * invYLocal, data->width);
                 int clampedXStart = max(0, xStart);
-                for (int x = clampedXStart; x < xEnd; x++)
-                {
-                    unsigned int leftEnergy =   getEnergyPixelE(data->imgSeam, x - 1, y + 1, data->width, data->height);
-                    unsigned int centerEnergy = getEnergyPixelE(data->imgSeam, x    , y + 1, data->width, data->height);
-                    unsigned int rightEnergy =  getEnergyPixelE(data->imgSeam, x + 1, y + 1, data->width, data->height);
+                seamKernels.dpRow(getSeamRow(data->imgSeam, y + 1, data->width),
+                                  &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                  getSeamRow(data->imgSeam, y, data->width),
+                                  clampedXStart, xEnd);
+            }
+        }
+    }
+}
+
+/// @brief Row stride of the strip-local cumulative energy plane (all strips with their halo and guards side by side)
+static inline int getStripSeamStride(ImageProcessData* data)
+{
+    return data->stride + data->seamsPerPass * (2 * data->stripHalo + 2 * SEAM_GUARD_COLUMNS);
+}
+
+/// @brief Get the first image column of the strip-local plane of a strip (the strip start minus the halo)
+static inline int getStripPlaneLowX(ImageProcessData* data, int stripIdx)
+{
+    return max(data->stripBounds[stripIdx] - data->stripHalo, 0);
+}
+
+/// @brief Get the cumulative energy row y the seam of the given strip follows, indexed with image x
+static inline unsigned int* getStripSeamRow(ImageProcessData* data, int stripIdx, int y)
+{
+    if (data->stripHalo < 0)
+    {
+        return getSeamRow(data->imgSeam, y, data->width);
+    }
+
+    // Strip s starts at column stripBounds[s] + s * (2 * halo + 2) of the plane row, so the strips never overlap
+    int planeOffsetX = data->stripBounds[stripIdx] + stripIdx * (2 * data->stripHalo + 2 * SEAM_GUARD_COLUMNS);
+    return &data->imgSeam[y * getStripSeamStride(data) + planeOffsetX + SEAM_GUARD_COLUMNS - getStripPlaneLowX(data, stripIdx)];
+}
+
+/// @brief Calculate the cumulative energy of each strip on its own (neighbours bounded to the strip plus the halo)
+void stripSeamIdentification(ImageProcessData* data)
+{
+    // One plane that holds every strip of a row next to each other, allocated once for the original width
+    if (data->imgSeam == NULL)
+    {
+        data->imgSeam = (unsigned int *) malloc(sizeof(unsigned int) * getStripSeamStride(data) * data->height);
+        if (data->imgSeam == NULL)
+        {
+            printf("Error: Couldn't allocate the strip seam planes.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /// Parallel:
+    // - annotate keeps each seam in its strip anyway, so the strips don't need each other's cumulative energy:
+    //   one task per strip runs its whole DP bottom-up without any barrier or wait on the other strips
+    // - the halo lets the DP see a few columns past the strip borders (read only, the seam itself stays in the strip)
+    #pragma omp parallel
+    #pragma omp single
+    for (int stripIdx = 0; stripIdx < data->seamCount; stripIdx++)
+    {
+        #pragma omp task firstprivate(stripIdx)
+        {
+            int planeLowX = getStripPlaneLowX(data, stripIdx);
+            int planeHighX = min(data->stripBounds[stripIdx + 1] + data->stripHalo, data->width);
+
+            for (int y = 0; y < data->height; y++)
+            {
+                unsigned int* seamRow = getStripSeamRow(data, stripIdx, y);
+                seamRow[planeLowX - 1] = SEAM_GUARD_VALUE;
+                seamRow[planeHighX] = SEAM_GUARD_VALUE;
+            }
+
+            // Fill bottom row with energy values
+            memcpy(&getStripSeamRow(data, stripIdx, data->height - 1)[planeLowX],
+                   &data->imgEnergy[getPixelIdx(planeLowX, data->height - 1, data->stride)],
+                   sizeof(unsigned int) * (planeHighX - planeLowX));
+
+            // (the DP kernel indexes seamRow, energyRow and the row below with the same x, so all are shifted to image x)
+            for (int y = data->height - 2; y >= 0; y--)
+            {
+                seamKernels.dpRow(getStripSeamRow(data, stripIdx, y + 1),
+                                  &data->imgEnergy[getPixelIdx(0, y, data->stride)],
+                                  getStripSeamRow(data, stripIdx, y),
+                                  planeLowX, planeHighX);
+            }
+        }
+    }
+}
+
+/// @brief Sum of the energy of a column (every STRIP_BORDER_ROW_STEP-th row)
+static inline unsigned long long getColumnEnergy(ImageProcessData* data, int x)
+{
+    unsigned long long energy = 0;
+    for (int y = 0; y < data->height; y += STRIP_BORDER_ROW_STEP)
+    {
+        energy += data->imgEnergy[getPixelIdx(x, y, data->stride)];
+    }
+
+    return energy;
+}
+
+/// @brief Split the image into seamCount strips for the next pass, each border is moved to the column with the
+/// lowest energy near the even split
+void updateStripBounds(ImageProcessData* data, int seamCount)
+{
+    data->seamCount = seamCount;
+    data->stripBounds[0] = 0;
+    data->stripBounds[seamCount] = data->width;
 
-                    unsigned int curEnergy = getEnergyPixelE(data->imgEnergy, x, y, data->width, data->height);
-                    unsigned int minEnergy = min(leftEnergy, min(centerEnergy, rightEnergy));
+    // Two neighbouring borders may both move towards each other, so each moves at most half of what the even split
+    // has above STRIP_MIN_WIDTH (the caller never splits into strips narrower than that)
+    const int evenStripWidth = data->width / seamCount;
+    const int searchRadius = max(min(evenStripWidth / STRIP_BORDER_SEARCH, (evenStripWidth - STRIP_MIN_WIDTH) / 2), 0);
 
-                    data->imgSeam[getPixelIdx(x, y, data->width)] = curEnergy + minEnergy;
-                }
+    /// Parallel:
+    // - every border is searched on its own (around the even split, the windows of two borders never overlap)
+    #pragma omp parallel for
+    for (int stripIdx = 1; stripIdx < seamCount; stripIdx++)
+    {
+        int evenX = (int) ((long long) stripIdx * data->width / seamCount);
+        int borderX = evenX;
+        unsigned long long borderEnergy = getColumnEnergy(data, evenX);
+        for (int x = max(evenX - searchRadius, 1); x <= min(evenX + searchRadius, data->width - 1); x++)
+        {
+            unsigned long long energy = getColumnEnergy(data, x);
+            if (energy < borderEnergy)
+            {
+                borderX = x;
+                borderEnergy = energy;
             }
         }
+
+        data->stripBounds[stripIdx] = borderX;
     }
 }
 
 /// @brief Annotate the seam in the image
 void seamAnnotate(ImageProcessData* data)
 {
-    const int stripWidth = data->width / SIM_NUM_SEAM_REMOVAL;
-
     #pragma omp parallel for
-    for (int seamIdx = 0; seamIdx < SIM_NUM_SEAM_REMOVAL; seamIdx++)
+    for (int seamIdx = 0; seamIdx < data->seamCount; seamIdx++)
     {
-        int lowX = seamIdx * stripWidth;
-        int highX = lowX + stripWidth;
+        int lowX = data->stripBounds[seamIdx];
+        int highX = data->stripBounds[seamIdx + 1];
 
         // Find the minimum energy in the top row on each image strip
         int curX = lowX;
         const int top_row = 0;
+        const unsigned int* seamRowTop = getStripSeamRow(data, seamIdx, top_row);
         for (int x = lowX + 1; x < highX; x++)
         {
-            if (data->imgSeam[getPixelIdx(x, top_row, data->width)] < data->imgSeam[getPixelIdx(curX, top_row, data->width)])
+            if (seamRowTop[x] < seamRowTop[curX])
             {
                 curX = x;
             }
@@ -495,9 +590,10 @@ void seamAnnotate(ImageProcessData* data)
         for (int y = 0; y < data->height - 1; y++)
         {
             // Find the minimum energy in the next row
-            unsigned int leftEnergy =   getEnergyPixelEStripe(data->imgSeam, curX - 1, y + 1, data->width, data->height, lowX, highX);
-            unsigned int centerEnergy = getEnergyPixelEStripe(data->imgSeam, curX    , y + 1, data->width, data->height, lowX, highX);
-            unsigned int rightEnergy =  getEnergyPixelEStripe(data->imgSeam, curX + 1, y + 1, data->width, data->height, lowX, highX);
+            const unsigned int* seamRowBelow = getStripSeamRow(data, seamIdx, y + 1);
+            unsigned int leftEnergy =   curX - 1 >= lowX ? seamRowBelow[curX - 1] : INT_MAX;
+            unsigned int centerEnergy = seamRowBelow[curX];
+            unsigned int rightEnergy =  curX + 1 < highX ? seamRowBelow[curX + 1] : INT_MAX;
 
             // Select next X
             if (leftEnergy < centerEnergy && leftEnergy < rightEnergy)
@@ -515,47 +611,28 @@ void seamAnnotate(ImageProcessData* data)
     }
 }
 
-/// @brief Remove the seam from the image
+/// @brief Remove the seams from the image
 void seamRemove(ImageProcessData* processData)
 {
-    // TODO: optimization: move pixels to the left (those after removed seam), then track the number of removed seams for index calc
-
-    // Allocate space for new image
-    unsigned int newWidth = processData->width - SIM_NUM_SEAM_REMOVAL;
-    unsigned int pixelCount = newWidth * processData->height;
-    unsigned char* image = (unsigned char *) malloc(sizeof(unsigned char) * pixelCount * processData->channelCount);
-
-    // Copy image data without seam
+    // Compact the image in place (rows keep their stride, only the pixels right of each seam move)
     /// Parallel:
-    // - standard for parallel, as the copying of whole lines is nicely divided between threads
+    // - standard for parallel, as the rows are nicely divided between threads and each row only touches itself
+    // - the seams are sorted by strip, so each row is compacted in segments between them (one memmove each)
     #pragma omp parallel for
     for (int y = 0; y < processData->height; y++)
     {
-        int seanPassedCount = 0;
-        for (int x = 0; x < processData->width; x++)
+        int seamX[MAX_SEAMS_PER_PASS];
+        for (int seamIdx = 0; seamIdx < processData->seamCount; seamIdx++)
         {
-            if (!isSeam(processData, x, y, seanPassedCount))
-            {
-                unsigned int pixelIdxC = getPixelIdxC(x, y, processData->width, processData->channelCount);
-                for (int channel = 0; channel < processData->channelCount; channel++)
-                {
-                    unsigned int pixelPos = getPixelIdxC(x - seanPassedCount, y, newWidth, processData->channelCount);
-                    image[pixelPos + channel] = processData->img[pixelIdxC + channel];
-                }
-            }
-            else
-                seanPassedCount++;
+            seamX[seamIdx] = processData->seamPath[seamIdx][y];
         }
-    }
 
-    // Free old image and set new image
-    free(processData->img);
+        seamCompactRow(&processData->img[getPixelIdxC(0, y, processData->stride, processData->channelCount)],
+                       seamX, processData->seamCount, processData->width, processData->channelCount);
+    }
 
     // Update process data
-    processData->img = image;
-    processData->width = newWidth;
-    processData->height = processData->height;
-    processData->channelCount = processData->channelCount;
+    processData->width = processData->width - processData->seamCount;
 }
 
 #ifdef RENDER_LOADING_BAR_WIDTH
@@ -580,10 +657,52 @@ void updatePrintLoadingBar(int progress, int total)
 }
 #endif
 
+/// @brief Parse the optional arguments after the seam count (--engine=<name>, --halo=<columns>)
+bool parseOptions(int argc, char *args[], ProcessOptions* options)
+{
+    options->engine = ENGINE_GLOBAL;
+    options->stripHalo = STRIP_HALO_DEFAULT;
+
+    for (int argIdx = 4; argIdx < argc; argIdx++)
+    {
+        if (strncmp(args[argIdx], "--engine=", 9) == 0)
+        {
+            int engine = -1;
+            for (int e = 0; e < ENGINE_COUNT; e++)
+            {
+                if (strcmp(&args[argIdx][9], carvingEngineNames[e]) == 0) engine = e;
+            }
+
+            if (engine < 0)
+            {
+                printf("Error: Unknown engine %s.\n", &args[argIdx][9]);
+                return false;
+            }
+            options->engine = (CarvingEngine) engine;
+        }
+        else if (strncmp(args[argIdx], "--halo=", 7) == 0)
+        {
+            options->stripHalo = atoi(&args[argIdx][7]);
+            if (options->stripHalo < 0)
+            {
+                printf("Error: Incorrect value for the halo.\n");
+                return false;
+            }
+        }
+        else
+        {
+            printf("Error: Unknown argument %s.\n", args[argIdx]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int main(int argc, char *args[])
 {
     // Read arguments
-    if (argc != 4)
+    if (argc < 4)
     {
         printf("Error: Invalid amount of arguments. [%d]\n", argc);
         exit(EXIT_FAILURE);
@@ -596,12 +715,24 @@ int main(int argc, char *args[])
     int seamCount = atoi(args[3]);
     int outputHeight; // = atoi(args[4]); // Height stays the same
 
+    ProcessOptions options;
+    if (!parseOptions(argc, args, &options))
+    {
+        exit(EXIT_FAILURE);
+    }
+
     // Setup processing data struct //////////////////////////////////////////////////////
     ImageProcessData processData;
     processData.img = NULL;
     processData.imgEnergy = NULL;
     processData.imgSeam = NULL;
-    processData.seamPath = (int**) malloc(sizeof(int*) * SIM_NUM_SEAM_REMOVAL);
+    processData.stripHalo = options.engine == ENGINE_STRIP ? options.stripHalo : -1;
+
+    // One seam per thread and pass (every strip is a separate task / loop iteration)
+    const int seamsPerPass = min(omp_get_max_threads(), MAX_SEAMS_PER_PASS);
+    processData.seamPath = (int**) malloc(sizeof(int*) * seamsPerPass);
+    processData.stripBounds = (int*) malloc(sizeof(int) * (seamsPerPass + 1));
+    processData.seamCount = 0;
 
     // Load image //////////////////////////////////////////////////////////////////////////
     processData.img = stbi_load(imageInPath, &processData.width, &processData.height, &processData.channelCount, STB_COLOR_CHANNELS);
@@ -611,25 +742,37 @@ int main(int argc, char *args[])
         exit(EXIT_FAILURE);
     }
     printf("Loaded image %s of size %dx%d.\n", imageInPath, processData.width, processData.height);
+    processData.stride = processData.width;
 
     if (seamCount >= processData.width || seamCount < 0)
     {
         printf("Error: Incorrect value for number of seams.\n");
         return EXIT_FAILURE;
     }
-    if (seamCount % SIM_NUM_SEAM_REMOVAL || processData.width % SIM_NUM_SEAM_REMOVAL)
-    {   // TODO fix: the num of of simultaneously removed seams has to divide num of total removed seams and image width
-        printf("Error: seamCount and image width should be divisible by the SIM_NUM_SEAM_REMOVAL!\n");
-        return EXIT_FAILURE;
+
+    // No pass uses more strips than the seams it removes or than fit at STRIP_MIN_WIDTH
+    processData.seamsPerPass = max(min(min(seamsPerPass, seamCount), processData.width / STRIP_MIN_WIDTH), 1);
+
+    // Every strip reserves 2 * halo columns in each plane row, so the halo is bounded by the widest strip (even split
+    // plus the border search on both sides): the DP of a strip then sees its whole neighbouring strips and a plane row
+    // stays below about four image rows for any thread count
+    const int evenStripWidth = (processData.width + processData.seamsPerPass - 1) / processData.seamsPerPass;
+    const int widestStrip = evenStripWidth + 2 * (evenStripWidth / STRIP_BORDER_SEARCH) + 1;
+    if (processData.stripHalo > widestStrip)
+    {
+        processData.stripHalo = widestStrip;
     }
 
-    for (int seamIdx = 0; seamIdx < SIM_NUM_SEAM_REMOVAL; seamIdx++)
+    for (int seamIdx = 0; seamIdx < seamsPerPass; seamIdx++)
     {
         processData.seamPath[seamIdx] = (int *) malloc(sizeof(int) * processData.height);
     }
 
     outputHeight = processData.height;
 
+    // Select SIMD kernels //////////////////////////////////////////////////////////////////////
+    seamKernelsInit();
+
     // Process image //////////////////////////////////////////////////////////////////////////
     TimingStats timingStats = {0};
     timingStats.cpus = omp_get_max_threads() / 2;
@@ -639,21 +782,35 @@ int main(int argc, char *args[])
     calculateEnergyFull(&processData);
     double stopEnergyTime = omp_get_wtime();
     timingStats.energyCalculations += stopEnergyTime - startEnergyTime;
-    for (int passIdx = 0; passIdx < seamCount / SIM_NUM_SEAM_REMOVAL; passIdx++)
+    // Every pass removes up to seamsPerPass seams, the last one only the remainder
+    // (narrow images use fewer strips, so no strip gets narrower than STRIP_MIN_WIDTH)
+    int passIdx = 0;
+    for (int seamsRemoved = 0; seamsRemoved < seamCount; seamsRemoved += processData.seamCount, passIdx++)
     {
         // Energy step
         startEnergyTime = omp_get_wtime();
         if (passIdx != 0) {
             updateEnergyOnSeam(&processData);
-            // updateEnergyOnSeamUpgrade(&processData);
         }
         stopEnergyTime = omp_get_wtime();
         timingStats.energyCalculations += stopEnergyTime - startEnergyTime;
 
-        // Seam identification step
+        // Seam identification step (strip borders of this pass first)
         double startSeamTime = omp_get_wtime();
-        seamIdentification(&processData);
-        // triangleSeamIdentification(&processData);
+        int passSeamCount = min(min(processData.seamsPerPass, seamCount - seamsRemoved), processData.width / STRIP_MIN_WIDTH);
+        updateStripBounds(&processData, max(passSeamCount, 1));
+        switch (options.engine)
+        {
+            case ENGINE_TRIANGLES:
+                triangleSeamIdentification(&processData);
+                break;
+            case ENGINE_STRIP:
+                stripSeamIdentification(&processData);
+                break;
+            default:
+                seamIdentification(&processData);
+                break;
+        }
         double stopSeamTime = omp_get_wtime();
         timingStats.seamIdentifications += stopSeamTime - startSeamTime;
 
@@ -670,7 +827,7 @@ int main(int argc, char *args[])
         timingStats.seamRemoves += stopSeamRemoveTime - startSeamRemoveTime;
 
 #ifdef RENDER_LOADING_BAR_WIDTH
-        updatePrintLoadingBar(passIdx + 1, seamCount / SIM_NUM_SEAM_REMOVAL);
+        updatePrintLoadingBar(seamsRemoved + processData.seamCount, seamCount);
 #endif
     }
     double stopTotalProcessingTime = omp_get_wtime();
@@ -684,7 +841,12 @@ int main(int argc, char *args[])
 #endif
 
     // Free process data //////////////////////////////////////////////////////////////////////////
+    for (int seamIdx = 0; seamIdx < seamsPerPass; seamIdx++)
+    {
+        free(processData.seamPath[seamIdx]);
+    }
     free(processData.seamPath);
+    free(processData.stripBounds);
     free(processData.imgSeam);
     free(processData.imgEnergy);
 
@@ -694,7 +856,7 @@ int main(int argc, char *args[])
                    processData.height,
                    processData.channelCount,
                    processData.img,
-                   processData.width * processData.channelCount);
+                   processData.stride * processData.channelCount);
 
     printf("Output image %s of size %dx%d.\n", imageOutPath, processData.width, processData.height);
 
@@ -703,6 +865,9 @@ int main(int argc, char *args[])
     // Output timing stats //////////////////////////////////////////////////////////////////////////
     printf("--------------- Timing Stats ---------------\n");
     printf("CPUs: %d\n", timingStats.cpus);
+    printf("SIMD Kernels: %s\n", simdTierNames[seamKernels.tier]);
+    printf("Engine: %s\n", carvingEngineNames[options.engine]);
+    printf("Seams per Pass: %d\n", processData.seamsPerPass);
     printf("Total Processing Time: %fs\n", timingStats.totalProcessingTime);
     printf("Energy Calculations: %fs [%f %%]\n", timingStats.energyCalculations, timingStats.energyCalculations / timingStats.totalProcessingTime * 100);
     printf("Seam Identifications: %fs [%f %%]\n", timingStats.seamIdentifications, timingStats.seamIdentifications / timingStats.totalProcessingTime * 100);
@@ -715,6 +880,9 @@ int main(int argc, char *args[])
     fprintf(timingFile, "--------------- PARALLEL SEAM CARVING TRIANGLES GREEDY ---------------\n", imageInPath);
     fprintf(timingFile, "--------------- %s ---------------\n", imageInPath);
     fprintf(timingFile, "CPUs: %d\n", timingStats.cpus);
+    fprintf(timingFile, "SIMD Kernels: %s\n", simdTierNames[seamKernels.tier]);
+    fprintf(timingFile, "Engine: %s\n", carvingEngineNames[options.engine]);
+    fprintf(timingFile, "Seams per Pass: %d\n", processData.seamsPerPass);
     fprintf(timingFile, "Arguments: imageInPath=%s, imageOutPath=%s, seamCount=%s\n", args[1], args[2], args[3]);
     fprintf(timingFile, "--------------- Timing Stats ---------------\n");
     fprintf(timingFile, "Total Processing Time: %fs\n", timingStats.totalProcessingTime);
@@ -13,4 +13,5 @@ PROGRAM=$1
 PROGRAM_OUT="bin/$(basename "$PROGRAM" .c).out"
 
 # Compile the program
+# (plain -O2 on purpose: SIMD kernels are selected at runtime from cpuid, set SEAM_CARVING_SIMD to force a tier)
 gcc -O2 -lm --openmp "$PROGRAM" -o "$PROGRAM_OUT"
\ No newline at end of file
@@ -0,0 +1,1329 @@
+#ifndef SEAM_CARVING_KERNELS_H
+#define SEAM_CARVING_KERNELS_H
+
+// SYSTEM LIBS //////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <limits.h>
+#include <immintrin.h>
+
+// CONSTANTS //////////////////////////////////////////////////////////////////////////////
+#define PADDED_BORDER 1        // Replicated border around the image (the sobel operator reaches one pixel out)
+#define PADDED_ROW_SLACK 64    // Extra bytes at the end of each padded row so vector loads never leave the row
+#define PADDED_RING_ROWS 4     // Image rows a streaming ring holds (the 3 the sobel operator reads + 1 filled ahead)
+#define SEAM_GUARD_COLUMNS 1   // Guard columns on each side of a cumulative energy row
+#define SEAM_GUARD_VALUE INT_MAX  // Same value getEnergyPixelE returns outside the image, so it never wins the min
+#define SOBEL_ENERGY_MAX 1442  // floor(sqrt(2 * 1020^2)), the largest sobel energy of a pixel (fits 16 bit energy rows)
+#define SOBEL_L1_ENERGY_MAX 2040  // 2 * 1020, the largest |Gx| + |Gy| of a pixel (the largest of all energy functions)
+#define GRADIENT_ENERGY_MAX 510   // 2 * 255, the largest two-tap gradient of a pixel
+#define THREAD_RANGE_ALIGN 16  // Column ranges handed to threads are multiples of the widest vector (16 x 32 bit)
+#define SIMD_TIER_ENV "SEAM_CARVING_SIMD"  // Environment variable to force a kernel tier (scalar, sse4.2, avx2, avx512)
+#define SEAM_DIR_LEFT 0        // Direction codes of the packed direction map (next x = x + code - 1)
+#define SEAM_DIR_CENTER 1
+#define SEAM_DIR_RIGHT 2
+
+/// Kernel dispatch:
+// - The binary is built with plain -O2, every vector kernel is compiled for its own instruction set with
+//   __attribute__((target(...))), so one binary carries all tiers.
+// - seamKernelsInit picks the widest tier the CPU supports (cpuid through __builtin_cpu_supports) and fills
+//   seamKernels with the energy, DP-row (with and without directions) and seam-remove kernels of that tier, the
+//   energy and DP-row kernels for 32 bit and for 16 bit energy rows. SEAM_CARVING_SIMD forces a lower
+//   tier for benchmarking (a tier the CPU can't run is rejected and the detected tier is used instead).
+
+/// Guarded cumulative energy rows:
+// - imgSeam rows are stored with a SEAM_GUARD_VALUE column on each side, so the DP reads x - 1 and x + 1 for every
+//   column without a bounds check and the left/center/right min has no branches (vectorizes in every tier).
+
+/// In-place compaction:
+// - img and imgEnergy keep the row stride of the original width, removing a seam only moves the part of each row
+//   right of the seam to the left (seamCompactRow), so the buffers are never reallocated or copied whole.
+
+/// Direction map:
+// - The rolling DP only keeps two cumulative energy rows and stores where the min of each pixel came from as a 2-bit
+//   code, four pixels per byte (7680x4320: about 8 MB instead of 130 MB for a full imgSeam plane).
+// - The codes follow the tie-breaking of seamAnnotate (left/right only when strictly smaller than both others), so
+//   chasing them from the top row gives exactly the seam seamAnnotate finds on the full plane.
+// - The vector kernels write whole bytes, so xStart has to be a multiple of 4 and xEnd a multiple of 4 or the row end
+//   (getThreadRange ranges are).
+// - Cumulative energies stay below 2^31 (the guard is INT_MAX), so the signed compares of SSE/AVX2 are exact.
+
+/// Padded energy kernels:
+// - The image is copied into one plane per channel with a replicated border, so the sobel operator can read its
+//   3x3 neighbourhood without clamping coordinates (same result as getPixelE which clamps to the closest pixel).
+// - Gx^2 + Gy^2 is at most 2 * 1020^2 < 2^24, so it is exact in float and floor(sqrtf(n)) == floor(sqrt(n)) for
+//   every possible n (checked exhaustively). The vector kernels therefore match calculatePixelEnergy exactly
+//   (tolerance 0), and the float sqrt of channelEnergy gives the same sobel energy as the original sqrt(pow(...)).
+
+/// Compact energy:
+// - The energy of a pixel is at most SOBEL_ENERGY_MAX, so an energy plane fits in 16 bits without saturating and the
+//   *16 kernels give exactly the same results as the 32 bit ones with half the energy bytes to write and to read.
+// - The 16 bit energy kernels pack two vectors of 32 bit lanes into one full vector of 16 bit lanes per store
+//   (8 / 16 / 32 pixels per step instead of 4 / 8 / 16), the 16 bit DP kernels load the energy at half the width and
+//   widen it, so one vector load of energy feeds twice the columns.
+// - The cumulative energy stays 32 bit: a path sums one energy per row, so it is at most height * SOBEL_ENERGY_MAX,
+//   below SEAM_GUARD_VALUE (2^31 - 1) for every image up to about 1.49 million rows. 16 bit cumulative rows would need a
+//   renormalization per row and can still overflow, as the spread of a row is not bounded.
+
+/// Energy functions:
+// - sobel (the original sqrt(Gx^2 + Gy^2)), sobel-l1 (|Gx| + |Gy|, integer only), gradient (|I(x + 1) - I(x - 1)| +
+//   |I(y + 1) - I(y - 1)|, two taps per direction, 4 loads instead of 8) and forward energy (see "Forward energy
+//   kernels", its cost is added in the DP). --energy=<name> selects one per run.
+// - The per pixel functions are written once for every tier (channelEnergy and the energyVector helpers), their energy
+//   row kernels are generated per function with the function as a constant argument of the always_inline helpers, so
+//   the compiler keeps only the arithmetic of that function in every kernel (no branch per pixel or row).
+// - Every per pixel energy is at most SOBEL_L1_ENERGY_MAX, so all of them fit 16 bit energy rows, and the cumulative
+//   energy stays below SEAM_GUARD_VALUE for images up to about a million rows.
+
+/// Channel count kernels:
+// - Images are loaded with their own channel count (STB_COLOR_CHANNELS 0), so it is only known at runtime. The per pixel
+//   channel loops (copying a row into the padded planes, the scalar sobel operator) are generated for 1 (grayscale),
+//   3 (RGB) and 4 (RGBA) channels with the counts as constants and picked once per image, other counts use a generic
+//   version. Grayscale rows are a plain copy and the energy needs no division.
+// - Alpha (the last channel of RGBA and grayscale + alpha) is carried through the carving like the other channels but
+//   takes no part in the energy (getEnergyChannelCount), the padded image only holds the energy channels.
+
+/// Streaming energy:
+// - A PaddedImage can also be a ring of PADDED_RING_ROWS image rows (paddedRingAlloc) instead of the whole image.
+//   Row y lives in slot y mod PADDED_RING_ROWS and again PADDED_RING_ROWS slots later, so rows y - 1, y and y + 1
+//   are always three consecutive slots and the energy kernels run unchanged on a view of them (paddedRingView).
+
+/// @brief Copy one interleaved image row (imgChannelCount channels) into the padded rows at dst of the first channelCount
+/// planes (planeSize bytes apart) and replicate the left/right border
+typedef void (*PaddedFillRowKernel)(unsigned char* dst, const unsigned char* src, int width, int planeSize, int imgChannelCount, int channelCount);
+
+typedef struct __PaddedImage__
+{
+    unsigned char* planes;  // channelCount planes of (height + 2) rows, each stride bytes wide
+    int stride;             // Bytes per padded row (width + 2 + slack)
+    int planeSize;          // Bytes per plane
+    int width;
+    int height;
+    int channelCount;       // Energy channels (one plane each)
+    int imgChannelCount;    // Channels of the interleaved image rows (with alpha)
+    PaddedFillRowKernel fillRow;  // Row copy of the image's channel count
+} PaddedImage;
+
+typedef enum __SimdTier__
+{
+    SIMD_TIER_SCALAR,
+    SIMD_TIER_SSE42,
+    SIMD_TIER_AVX2,
+    SIMD_TIER_AVX512,
+    SIMD_TIER_COUNT
+} SimdTier;
+
+static const char* simdTierNames[SIMD_TIER_COUNT] = { "scalar", "sse4.2", "avx2", "avx512" };
+
+typedef enum __EnergyFunction__
+{
+    ENERGY_SOBEL,       // Sobel magnitude sqrt(Gx^2 + Gy^2)
+    ENERGY_SOBEL_L1,    // Integer sobel |Gx| + |Gy|
+    ENERGY_GRADIENT,    // Two-tap gradient |I(x + 1) - I(x - 1)| + |I(y + 1) - I(y - 1)|
+    ENERGY_FORWARD,     // Forward energy (cost of the edges a seam creates, added in the DP, no per pixel energy)
+    ENERGY_FUNCTION_COUNT
+} EnergyFunction;
+
+#define PIXEL_ENERGY_FUNCTION_COUNT ENERGY_FORWARD  // The per pixel energy functions come before forward energy
+
+/// @brief Energy of one image row y computed from the padded planes
+typedef void (*EnergyRowKernel)(const PaddedImage* padded, unsigned int* energyRow, int y);
+/// @brief Cumulative energy of the columns [xStart, xEnd) of a row: seamRow[x] = energyRow[x] + min of the 3 pixels below
+// (seamRowBelow must be a guarded row, see getSeamRow)
+typedef void (*DpRowKernel)(const unsigned int* seamRowBelow, const unsigned int* energyRow, unsigned int* seamRow, int xStart, int xEnd);
+/// @brief DP row like DpRowKernel that also writes the 2-bit direction codes of [xStart, xEnd) into directionRow
+typedef void (*DpRowDirectionsKernel)(const unsigned int* seamRowBelow, const unsigned int* energyRow, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd);
+/// @brief EnergyRowKernel into a 16 bit energy row
+typedef void (*EnergyRow16Kernel)(const PaddedImage* padded, unsigned short* energyRow, int y);
+/// @brief DpRowKernel reading a 16 bit energy row
+typedef void (*DpRow16Kernel)(const unsigned int* seamRowBelow, const unsigned short* energyRow, unsigned int* seamRow, int xStart, int xEnd);
+/// @brief DpRowDirectionsKernel reading a 16 bit energy row
+typedef void (*DpRowDirections16Kernel)(const unsigned int* seamRowBelow, const unsigned short* energyRow, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd);
+/// @brief Forward energy costs of the 3 directions of every pixel of row y computed from the padded planes
+typedef void (*ForwardCostRowKernel)(const PaddedImage* padded, unsigned int* costUp, unsigned int* costLeft, unsigned int* costRight, int y);
+/// @brief Forward energy DP row: seamRow[x] = min of the 3 pixels below plus the cost of its direction, writes the
+/// direction codes like DpRowDirectionsKernel
+typedef void (*DpRowForwardKernel)(const unsigned int* seamRowBelow, const unsigned int* costUp, const unsigned int* costLeft, const unsigned int* costRight, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd);
+/// @brief Copy one image row without the pixels at the (ascending) seam positions
+typedef void (*SeamRemoveRowKernel)(const unsigned char* srcRow, unsigned char* dstRow, const int* seamX, int seamCount, int width, int channelCount);
+
+typedef struct __SeamKernels__
+{
+    SimdTier tier;
+    EnergyFunction energyFunction;
+    EnergyRowKernel energyRow;
+    DpRowKernel dpRow;
+    DpRowDirectionsKernel dpRowDirections;
+    EnergyRow16Kernel energyRow16;
+    DpRow16Kernel dpRow16;
+    DpRowDirections16Kernel dpRowDirections16;
+    ForwardCostRowKernel forwardCostRow;
+    DpRowForwardKernel dpRowForward;
+    SeamRemoveRowKernel seamRemoveRow;
+} SeamKernels;
+
+static SeamKernels seamKernels;
+
+// FUNCTIONS //////////////////////////////////////////////////////////////////////////////
+/// @brief Split [0, count) into one contiguous range per thread (chunk size is a multiple of align)
+static inline void getThreadRange(int count, int align, int threadIdx, int threadCount, int* start, int* end)
+{
+    int chunk = (count + threadCount - 1) / threadCount;
+    chunk = (chunk + align - 1) / align * align;
+
+    *start = threadIdx * chunk < count ? threadIdx * chunk : count;
+    *end = *start + chunk < count ? *start + chunk : count;
+}
+
+/// @brief Row stride of a guarded cumulative energy plane
+static inline int getSeamStride(int width)
+{
+    return width + 2 * SEAM_GUARD_COLUMNS;
+}
+
+/// @brief Get the pointer to column 0 of a guarded cumulative energy row (row[-1] and row[width] are guards)
+static inline unsigned int* getSeamRow(unsigned int* imgSeam, int y, int width)
+{
+    return &imgSeam[y * getSeamStride(width) + SEAM_GUARD_COLUMNS];
+}
+
+/// @brief Set the guard columns of a cumulative energy row
+static inline void seamRowSetGuards(unsigned int* seamRow, int width)
+{
+    seamRow[-1] = SEAM_GUARD_VALUE;
+    seamRow[width] = SEAM_GUARD_VALUE;
+}
+
+/// @brief Allocate a guarded cumulative energy plane and set its guard columns
+static inline unsigned int* seamPlaneAlloc(int width, int height)
+{
+    unsigned int* imgSeam = (unsigned int *) malloc(sizeof(unsigned int) * getSeamStride(width) * height);
+    for (int y = 0; y < height; y++)
+    {
+        seamRowSetGuards(getSeamRow(imgSeam, y, width), width);
+    }
+
+    return imgSeam;
+}
+
+/// @brief Remove the elements at the ascending seamX positions from a row in place (elementSize bytes each),
+/// every segment between two seams is moved left with one memmove
+static inline void seamCompactRow(void* row, const int* seamX, int seamCount, int width, int elementSize)
+{
+    unsigned char* bytes = (unsigned char *) row;
+    for (int seamIdx = 0; seamIdx < seamCount; seamIdx++)
+    {
+        int srcStart = seamX[seamIdx] + 1;
+        int srcEnd = seamIdx + 1 < seamCount ? seamX[seamIdx + 1] : width;
+        memmove(&bytes[(size_t) (srcStart - seamIdx - 1) * elementSize],
+                &bytes[(size_t) srcStart * elementSize],
+                (size_t) (srcEnd - srcStart) * elementSize);
+    }
+}
+
+/// @brief Bytes per row of a packed direction map (4 pixels per byte)
+static inline int getDirectionStride(int width)
+{
+    return (width + 3) / 4;
+}
+
+/// @brief Get the pointer to a row of a packed direction map
+static inline unsigned char* getDirectionRow(unsigned char* seamDirections, int y, int width)
+{
+    return &seamDirections[(size_t) y * getDirectionStride(width)];
+}
+
+/// @brief Read the direction code of column x from a packed direction row
+static inline int getDirection(const unsigned char* directionRow, int x)
+{
+    return (directionRow[x >> 2] >> ((x & 3) * 2)) & 3;
+}
+
+/// @brief Channels that take part in the energy (the alpha of grayscale + alpha and RGBA is left out)
+static inline int getEnergyChannelCount(int channelCount)
+{
+    return channelCount == 2 || channelCount == 4 ? channelCount - 1 : channelCount;
+}
+
+#define PADDED_FILL_ROW_KERNEL(name, IMG_CHANNELS, ENERGY_CHANNELS)                                                   \
+    static void name(unsigned char* dst, const unsigned char* src, int width, int planeSize, int imgChannelCount, int channelCount) \
+    {                                                                                                                 \
+        (void) imgChannelCount; /* Only the generic kernel reads the channel counts */                                \
+        (void) channelCount;                                                                                          \
+        for (int channel = 0; channel < ENERGY_CHANNELS; channel++)                                                   \
+        {                                                                                                             \
+            unsigned char* dstPlane = &dst[channel * planeSize];                                                      \
+            for (int x = 0; x < width; x++)                                                                           \
+            {                                                                                                         \
+                dstPlane[x] = src[x * IMG_CHANNELS + channel];                                                        \
+            }                                                                                                         \
+            dstPlane[-1] = dstPlane[0];                                                                               \
+            dstPlane[width] = dstPlane[width - 1];                                                                    \
+        }                                                                                                             \
+    }
+
+PADDED_FILL_ROW_KERNEL(paddedFillRowGray, 1, 1)
+PADDED_FILL_ROW_KERNEL(paddedFillRowRGB, 3, 3)
+PADDED_FILL_ROW_KERNEL(paddedFillRowRGBA, 4, 3)
+PADDED_FILL_ROW_KERNEL(paddedFillRowGeneric, imgChannelCount, channelCount)
+
+/// @brief Select the padded row copy of an image channel count
+static inline PaddedFillRowKernel getPaddedFillRowKernel(int imgChannelCount)
+{
+    switch (imgChannelCount)
+    {
+        case 1:  return paddedFillRowGray;
+        case 3:  return paddedFillRowRGB;
+        case 4:  return paddedFillRowRGBA;
+        default: return paddedFillRowGeneric;
+    }
+}
+
+/// @brief Get the pointer to the padded row of the given image row (y = -1 and y = height are the border rows)
+static inline const unsigned char* getPaddedRow(const PaddedImage* padded, int channel, int y)
+{
+    return &padded->planes[channel * padded->planeSize + (y + PADDED_BORDER) * padded->stride];
+}
+
+/// @brief Allocate the padded planes for an image of the given size
+static inline void paddedImageAlloc(PaddedImage* padded, int width, int height, int channelCount)
+{
+    padded->width = width;
+    padded->height = height;
+    padded->channelCount = getEnergyChannelCount(channelCount);
+    padded->imgChannelCount = channelCount;
+    padded->fillRow = getPaddedFillRowKernel(channelCount);
+    padded->stride = width + 2 * PADDED_BORDER + PADDED_ROW_SLACK;
+    padded->planeSize = padded->stride * (height + 2 * PADDED_BORDER);
+    padded->planes = (unsigned char *) calloc((size_t) padded->planeSize * padded->channelCount, sizeof(unsigned char));
+}
+
+/// @brief Free the padded planes
+static inline void paddedImageFree(PaddedImage* padded)
+{
+    free(padded->planes);
+    padded->planes = NULL;
+}
+
+/// @brief Copy image row y (interleaved channels, imgStride pixels per row) into the padded row that starts rowOffset
+/// bytes into every plane and replicate its left/right border
+static inline void paddedFillRowAt(PaddedImage* padded, const unsigned char* img, int imgStride, int y, size_t rowOffset)
+{
+    padded->fillRow(&padded->planes[rowOffset + PADDED_BORDER], &img[(size_t) y * imgStride * padded->imgChannelCount],
+                    padded->width, padded->planeSize, padded->imgChannelCount, padded->channelCount);
+}
+
+/// @brief Copy one image row (interleaved channels, imgStride pixels per row) into the padded planes and replicate
+/// its left/right border
+static inline void paddedImageFillRow(PaddedImage* padded, const unsigned char* img, int imgStride, int y)
+{
+    paddedFillRowAt(padded, img, imgStride, y, (size_t) (y + PADDED_BORDER) * padded->stride);
+}
+
+/// @brief Allocate a ring of padded rows for an image of the given width (every row is stored twice)
+static inline void paddedRingAlloc(PaddedImage* padded, int width, int channelCount)
+{
+    padded->width = width;
+    padded->height = PADDED_RING_ROWS;
+    padded->channelCount = getEnergyChannelCount(channelCount);
+    padded->imgChannelCount = channelCount;
+    padded->fillRow = getPaddedFillRowKernel(channelCount);
+    padded->stride = width + 2 * PADDED_BORDER + PADDED_ROW_SLACK;
+    padded->planeSize = padded->stride * 2 * PADDED_RING_ROWS;
+    padded->planes = (unsigned char *) calloc((size_t) padded->planeSize * padded->channelCount, sizeof(unsigned char));
+}
+
+/// @brief Get the first slot of ring row y (y may be -1 or height for the border rows)
+static inline int getPaddedRingSlot(int y)
+{
+    return ((y % PADDED_RING_ROWS) + PADDED_RING_ROWS) % PADDED_RING_ROWS;
+}
+
+/// @brief Copy image row imgY into the ring as row y (the border rows y = -1 and y = height repeat the closest row)
+static inline void paddedRingFillRow(PaddedImage* ring, const unsigned char* img, int imgStride, int imgY, int y)
+{
+    const size_t rowOffset = (size_t) getPaddedRingSlot(y) * ring->stride;
+    const size_t copyOffset = (size_t) PADDED_RING_ROWS * ring->stride;
+
+    paddedFillRowAt(ring, img, imgStride, imgY, rowOffset);
+    for (int channel = 0; channel < ring->channelCount; channel++)
+    {
+        unsigned char* row = &ring->planes[channel * ring->planeSize + rowOffset];
+        memcpy(row + copyOffset, row, ring->stride);
+    }
+}
+
+/// @brief Get a view of the columns [xStart, xEnd) of the ring in which image row y is row 0 (pass 0 as the row to the
+/// energy kernels)
+static inline PaddedImage paddedRingView(const PaddedImage* ring, int y, int xStart, int xEnd)
+{
+    PaddedImage view = *ring;
+    view.planes = &ring->planes[(size_t) getPaddedRingSlot(y - 1) * ring->stride + xStart];
+    view.width = xEnd - xStart;
+    view.height = 1;
+    return view;
+}
+
+/// @brief Replicate the top and bottom border rows (call after all rows were filled)
+static inline void paddedImageFillBorderRows(PaddedImage* padded)
+{
+    for (int channel = 0; channel < padded->channelCount; channel++)
+    {
+        memcpy((unsigned char *) getPaddedRow(padded, channel, -1), getPaddedRow(padded, channel, 0), padded->stride);
+        memcpy((unsigned char *) getPaddedRow(padded, channel, padded->height), getPaddedRow(padded, channel, padded->height - 1), padded->stride);
+    }
+}
+
+/// @brief Energy of one channel from its 3x3 neighbourhood a b c / d e f / g h i (no energy function reads e itself)
+__attribute__((always_inline))
+static inline int channelEnergy(EnergyFunction energyFunction, int a, int b, int c, int d, int f, int g, int h, int i)
+{
+    switch (energyFunction)
+    {
+        case ENERGY_SOBEL_L1:
+        {
+            int Gx = (c + 2 * f + i) - (a + 2 * d + g);
+            int Gy = (a + 2 * b + c) - (g + 2 * h + i);
+            return abs(Gx) + abs(Gy);
+        }
+        case ENERGY_GRADIENT:
+            return abs(f - d) + abs(b - h);
+        default:
+        {
+            int Gx = (c + 2 * f + i) - (a + 2 * d + g);
+            int Gy = (a + 2 * b + c) - (g + 2 * h + i);
+            return (int) sqrtf((float) (Gx * Gx + Gy * Gy));
+        }
+    }
+}
+
+/// @brief Calculate the energy of one pixel from the padded planes (no bounds checks)
+__attribute__((always_inline))
+static inline unsigned int calculatePixelEnergyPadded(const PaddedImage* padded, int x, int y, EnergyFunction energyFunction)
+{
+    int energy = 0;
+    for (int channel = 0; channel < padded->channelCount; channel++)
+    {
+        const unsigned char* r0 = getPaddedRow(padded, channel, y - 1) + x;
+        const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+        const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+        energy += channelEnergy(energyFunction, r0[0], r0[1], r0[2], r1[0], r1[2], r2[0], r2[1], r2[2]);
+    }
+
+    return energy / padded->channelCount;
+}
+
+/// @brief Widen the 4 bytes at bytes to 32 bit lanes (memcpy instead of an int cast, bytes has any alignment)
+__attribute__((target("sse4.2"), always_inline))
+static inline __m128i loadBytes4SSE42(const unsigned char* bytes)
+{
+    int packed;
+    memcpy(&packed, bytes, sizeof(packed));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+}
+
+/// @brief SSE4.2 energy of the 4 pixels [x, x + 4) of row y from the padded planes
+__attribute__((target("sse4.2"), always_inline))
+static inline __m128i energyVectorSSE42(const PaddedImage* padded, int x, int y, EnergyFunction energyFunction)
+{
+    __m128i energy = _mm_setzero_si128();
+    for (int channel = 0; channel < padded->channelCount; channel++)
+    {
+        const unsigned char* r0 = getPaddedRow(padded, channel, y - 1) + x;
+        const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+        const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+        __m128i b = loadBytes4SSE42(r0 + 1);
+        __m128i d = loadBytes4SSE42(r1);
+        __m128i f = loadBytes4SSE42(r1 + 2);
+        __m128i h = loadBytes4SSE42(r2 + 1);
+        if (energyFunction == ENERGY_GRADIENT)
+        {
+            energy = _mm_add_epi32(energy, _mm_add_epi32(_mm_abs_epi32(_mm_sub_epi32(f, d)), _mm_abs_epi32(_mm_sub_epi32(b, h))));
+            continue;
+        }
+
+        __m128i a = loadBytes4SSE42(r0);
+        __m128i c = loadBytes4SSE42(r0 + 2);
+        __m128i g = loadBytes4SSE42(r2);
+        __m128i i = loadBytes4SSE42(r2 + 2);
+
+        __m128i Gx = _mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(c, i), _mm_slli_epi32(f, 1)),
+                                   _mm_add_epi32(_mm_add_epi32(a, g), _mm_slli_epi32(d, 1)));
+        __m128i Gy = _mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(a, c), _mm_slli_epi32(b, 1)),
+                                   _mm_add_epi32(_mm_add_epi32(g, i), _mm_slli_epi32(h, 1)));
+        if (energyFunction == ENERGY_SOBEL_L1)
+        {
+            energy = _mm_add_epi32(energy, _mm_add_epi32(_mm_abs_epi32(Gx), _mm_abs_epi32(Gy)));
+            continue;
+        }
+
+        __m128i magnitude2 = _mm_add_epi32(_mm_mullo_epi32(Gx, Gx), _mm_mullo_epi32(Gy, Gy));
+        __m128 magnitude = _mm_sqrt_ps(_mm_cvtepi32_ps(magnitude2));
+        energy = _mm_add_epi32(energy, _mm_cvttps_epi32(magnitude));
+    }
+
+    if (padded->channelCount > 1)
+    {
+        energy = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(energy), _mm_set1_ps((float) padded->channelCount)));
+    }
+    return energy;
+}
+
+/// @brief AVX2 energy of the 8 pixels [x, x + 8) of row y from the padded planes
+__attribute__((target("avx2"), always_inline))
+static inline __m256i energyVectorAVX2(const PaddedImage* padded, int x, int y, EnergyFunction energyFunction)
+{
+    __m256i energy = _mm256_setzero_si256();
+    for (int channel = 0; channel < padded->channelCount; channel++)
+    {
+        const unsigned char* r0 = getPaddedRow(padded, channel, y - 1) + x;
+        const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+        const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+        __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r0 + 1)));
+        __m256i d = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r1    )));
+        __m256i f = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r1 + 2)));
+        __m256i h = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r2 + 1)));
+        if (energyFunction == ENERGY_GRADIENT)
+        {
+            energy = _mm256_add_epi32(energy, _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(f, d)), _mm256_abs_epi32(_mm256_sub_epi32(b, h))));
+            continue;
+        }
+
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r0    )));
+        __m256i c = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r0 + 2)));
+        __m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r2    )));
+        __m256i i = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r2 + 2)));
+
+        // Gx = (c + 2f + i) - (a + 2d + g), Gy = (a + 2b + c) - (g + 2h + i)
+        __m256i Gx = _mm256_sub_epi32(_mm256_add_epi32(_mm256_add_epi32(c, i), _mm256_slli_epi32(f, 1)),
+                                      _mm256_add_epi32(_mm256_add_epi32(a, g), _mm256_slli_epi32(d, 1)));
+        __m256i Gy = _mm256_sub_epi32(_mm256_add_epi32(_mm256_add_epi32(a, c), _mm256_slli_epi32(b, 1)),
+                                      _mm256_add_epi32(_mm256_add_epi32(g, i), _mm256_slli_epi32(h, 1)));
+        if (energyFunction == ENERGY_SOBEL_L1)
+        {
+            energy = _mm256_add_epi32(energy, _mm256_add_epi32(_mm256_abs_epi32(Gx), _mm256_abs_epi32(Gy)));
+            continue;
+        }
+
+        __m256i magnitude2 = _mm256_add_epi32(_mm256_mullo_epi32(Gx, Gx), _mm256_mullo_epi32(Gy, Gy));
+        __m256 magnitude = _mm256_sqrt_ps(_mm256_cvtepi32_ps(magnitude2));
+        energy = _mm256_add_epi32(energy, _mm256_cvttps_epi32(magnitude));
+    }
+
+    if (padded->channelCount > 1)
+    {
+        energy = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(energy), _mm256_set1_ps((float) padded->channelCount)));
+    }
+    return energy;
+}
+
+/// @brief AVX-512 energy of the 16 pixels [x, x + 16) of row y from the padded planes (loads past the row end stay
+/// inside PADDED_ROW_SLACK)
+__attribute__((target("avx512f"), always_inline))
+static inline __m512i energyVectorAVX512(const PaddedImage* padded, int x, int y, EnergyFunction energyFunction)
+{
+    __m512i energy = _mm512_setzero_si512();
+    for (int channel = 0; channel < padded->channelCount; channel++)
+    {
+        const unsigned char* r0 = getPaddedRow(padded, channel, y - 1) + x;
+        const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+        const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+        __m512i b = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r0 + 1)));
+        __m512i d = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r1    )));
+        __m512i f = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r1 + 2)));
+        __m512i h = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r2 + 1)));
+        if (energyFunction == ENERGY_GRADIENT)
+        {
+            energy = _mm512_add_epi32(energy, _mm512_add_epi32(_mm512_abs_epi32(_mm512_sub_epi32(f, d)), _mm512_abs_epi32(_mm512_sub_epi32(b, h))));
+            continue;
+        }
+
+        __m512i a = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r0    )));
+        __m512i c = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r0 + 2)));
+        __m512i g = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r2    )));
+        __m512i i = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r2 + 2)));
+
+        __m512i Gx = _mm512_sub_epi32(_mm512_add_epi32(_mm512_add_epi32(c, i), _mm512_slli_epi32(f, 1)),
+                                      _mm512_add_epi32(_mm512_add_epi32(a, g), _mm512_slli_epi32(d, 1)));
+        __m512i Gy = _mm512_sub_epi32(_mm512_add_epi32(_mm512_add_epi32(a, c), _mm512_slli_epi32(b, 1)),
+                                      _mm512_add_epi32(_mm512_add_epi32(g, i), _mm512_slli_epi32(h, 1)));
+        if (energyFunction == ENERGY_SOBEL_L1)
+        {
+            energy = _mm512_add_epi32(energy, _mm512_add_epi32(_mm512_abs_epi32(Gx), _mm512_abs_epi32(Gy)));
+            continue;
+        }
+
+        __m512i magnitude2 = _mm512_add_epi32(_mm512_mullo_epi32(Gx, Gx), _mm512_mullo_epi32(Gy, Gy));
+        __m512 magnitude = _mm512_sqrt_ps(_mm512_cvtepi32_ps(magnitude2));
+        energy = _mm512_add_epi32(energy, _mm512_cvttps_epi32(magnitude));
+    }
+
+    if (padded->channelCount > 1)
+    {
+        energy = _mm512_cvttps_epi32(_mm512_div_ps(_mm512_cvtepi32_ps(energy), _mm512_set1_ps((float) padded->channelCount)));
+    }
+    return energy;
+}
+
+/// Energy row kernels:
+// - Generated per energy function (see "Energy functions"), each for 32 bit and 16 bit energy rows.
+// Scalar
+#define ENERGY_ROW_KERNEL_SCALAR(name, EnergyType, ENERGY_FUNCTION)                                                   \
+    static void name(const PaddedImage* padded, EnergyType* energyRow, int y)                                         \
+    {                                                                                                                 \
+        for (int x = 0; x < padded->width; x++)                                                                       \
+        {                                                                                                             \
+            energyRow[x] = (EnergyType) calculatePixelEnergyPadded(padded, x, y, ENERGY_FUNCTION);                    \
+        }                                                                                                             \
+    }
+
+// SSE4.2: 4 pixels per step
+#define ENERGY_ROW_KERNEL_SSE42(name, ENERGY_FUNCTION)                                                                \
+    static void name(const PaddedImage* padded, unsigned int* energyRow, int y)                                       \
+    {                                                                                                                 \
+        const int width = padded->width;                                                                              \
+        int x = 0;                                                                                                    \
+        for (; x + 4 <= width; x += 4)                                                                                \
+        {                                                                                                             \
+            _mm_storeu_si128((__m128i *) &energyRow[x], energyVectorSSE42(padded, x, y, ENERGY_FUNCTION));            \
+        }                                                                                                             \
+        for (; x < width; x++)                                                                                        \
+        {                                                                                                             \
+            energyRow[x] = calculatePixelEnergyPadded(padded, x, y, ENERGY_FUNCTION);                                 \
+        }                                                                                                             \
+    }
+
+// SSE4.2 into a 16 bit energy row: 8 pixels = one full vector per step
+#define ENERGY_ROW16_KERNEL_SSE42(name, ENERGY_FUNCTION)                                                              \
+    static void name(const PaddedImage* padded, unsigned short* energyRow, int y)                                     \
+    {                                                                                                                 \
+        const int width = padded->width;                                                                              \
+        int x = 0;                                                                                                    \
+        for (; x + 8 <= width; x += 8)                                                                                \
+        {                                                                                                             \
+            __m128i energy = _mm_packus_epi32(energyVectorSSE42(padded, x, y, ENERGY_FUNCTION),                       \
+                                              energyVectorSSE42(padded, x + 4, y, ENERGY_FUNCTION));                  \
+            _mm_storeu_si128((__m128i *) &energyRow[x], energy);                                                      \
+        }                                                                                                             \
+        for (; x < width; x++)                                                                                        \
+        {                                                                                                             \
+            energyRow[x] = (unsigned short) calculatePixelEnergyPadded(padded, x, y, ENERGY_FUNCTION);                \
+        }                                                                                                             \
+    }
+
+// AVX2: 8 pixels per step
+#define ENERGY_ROW_KERNEL_AVX2(name, ENERGY_FUNCTION)                                                                 \
+    static void name(const PaddedImage* padded, unsigned int* energyRow, int y)                                       \
+    {                                                                                                                 \
+        const int width = padded->width;                                                                              \
+        int x = 0;                                                                                                    \
+        for (; x + 8 <= width; x += 8)                                                                                \
+        {                                                                                                             \
+            _mm256_storeu_si256((__m256i *) &energyRow[x], energyVectorAVX2(padded, x, y, ENERGY_FUNCTION));          \
+        }                                                                                                             \
+        for (; x < width; x++)                                                                                        \
+        {                                                                                                             \
+            energyRow[x] = calculatePixelEnergyPadded(padded, x, y, ENERGY_FUNCTION);                                 \
+        }                                                                                                             \
+    }
+
+// AVX2 into a 16 bit energy row: 16 pixels = one full vector per step (packus works per 128 bit lane, the permute puts
+// the 4 quarters back in pixel order)
+#define ENERGY_ROW16_KERNEL_AVX2(name, ENERGY_FUNCTION)                                                               \
+    static void name(const PaddedImage* padded, unsigned short* energyRow, int y)                                     \
+    {                                                                                                                 \
+        const int width = padded->width;                                                                              \
+        int x = 0;                                                                                                    \
+        for (; x + 16 <= width; x += 16)                                                                              \
+        {                                                                                                             \
+            __m256i energy = _mm256_packus_epi32(energyVectorAVX2(padded, x, y, ENERGY_FUNCTION),                     \
+                                                 energyVectorAVX2(padded, x + 8, y, ENERGY_FUNCTION));                \
+            _mm256_storeu_si256((__m256i *) &energyRow[x], _mm256_permute4x64_epi64(energy, 0xD8));                   \
+        }                                                                                                             \
+        for (; x < width; x++)                                                                                        \
+        {                                                                                                             \
+            energyRow[x] = (unsigned short) calculatePixelEnergyPadded(padded, x, y, ENERGY_FUNCTION);                \
+        }                                                                                                             \
+    }
+
+// AVX-512: 16 pixels per step, masked tail
+#define ENERGY_ROW_KERNEL_AVX512(name, ENERGY_FUNCTION)                                                               \
+    static void name(const PaddedImage* padded, unsigned int* energyRow, int y)                                       \
+    {                                                                                                                 \
+        const int width = padded->width;                                                                              \
+        for (int x = 0; x < width; x += 16)                                                                           \
+        {                                                                                                             \
+            __mmask16 storeMask = width - x >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << (width - x)) - 1);       \
+            _mm512_mask_storeu_epi32(&energyRow[x], storeMask, energyVectorAVX512(padded, x, y, ENERGY_FUNCTION));    \
+        }                                                                                                             \
+    }
+
+// AVX-512 into a 16 bit energy row: 32 pixels = one full vector per step, masked tail
+#define ENERGY_ROW16_KERNEL_AVX512(name, ENERGY_FUNCTION)                                                             \
+    static void name(const PaddedImage* padded, unsigned short* energyRow, int y)                                     \
+    {                                                                                                                 \
+        const int width = padded->width;                                                                              \
+        for (int x = 0; x < width; x += 32)                                                                           \
+        {                                                                                                             \
+            __mmask32 storeMask = width - x >= 32 ? ~(__mmask32) 0 : (__mmask32) ((1u << (width - x)) - 1);           \
+            __m256i energyLow = _mm512_cvtepi32_epi16(energyVectorAVX512(padded, x, y, ENERGY_FUNCTION));             \
+            __m256i energyHigh = _mm512_cvtepi32_epi16(energyVectorAVX512(padded, x + 16, y, ENERGY_FUNCTION));       \
+            _mm512_mask_storeu_epi16(&energyRow[x], storeMask, _mm512_inserti64x4(_mm512_castsi256_si512(energyLow), energyHigh, 1)); \
+        }                                                                                                             \
+    }
+
+
+ENERGY_ROW_KERNEL_SCALAR(energyRowSobelScalar, unsigned int, ENERGY_SOBEL)
+ENERGY_ROW_KERNEL_SCALAR(energyRow16SobelScalar, unsigned short, ENERGY_SOBEL)
+__attribute__((target("sse4.2"))) ENERGY_ROW_KERNEL_SSE42(energyRowSobelSSE42, ENERGY_SOBEL)
+__attribute__((target("sse4.2"))) ENERGY_ROW16_KERNEL_SSE42(energyRow16SobelSSE42, ENERGY_SOBEL)
+__attribute__((target("avx2"))) ENERGY_ROW_KERNEL_AVX2(energyRowSobelAVX2, ENERGY_SOBEL)
+__attribute__((target("avx2"))) ENERGY_ROW16_KERNEL_AVX2(energyRow16SobelAVX2, ENERGY_SOBEL)
+__attribute__((target("avx512f"))) ENERGY_ROW_KERNEL_AVX512(energyRowSobelAVX512, ENERGY_SOBEL)
+__attribute__((target("avx512f,avx512bw"))) ENERGY_ROW16_KERNEL_AVX512(energyRow16SobelAVX512, ENERGY_SOBEL)
+
+ENERGY_ROW_KERNEL_SCALAR(energyRowSobelL1Scalar, unsigned int, ENERGY_SOBEL_L1)
+ENERGY_ROW_KERNEL_SCALAR(energyRow16SobelL1Scalar, unsigned short, ENERGY_SOBEL_L1)
+__attribute__((target("sse4.2"))) ENERGY_ROW_KERNEL_SSE42(energyRowSobelL1SSE42, ENERGY_SOBEL_L1)
+__attribute__((target("sse4.2"))) ENERGY_ROW16_KERNEL_SSE42(energyRow16SobelL1SSE42, ENERGY_SOBEL_L1)
+__attribute__((target("avx2"))) ENERGY_ROW_KERNEL_AVX2(energyRowSobelL1AVX2, ENERGY_SOBEL_L1)
+__attribute__((target("avx2"))) ENERGY_ROW16_KERNEL_AVX2(energyRow16SobelL1AVX2, ENERGY_SOBEL_L1)
+__attribute__((target("avx512f"))) ENERGY_ROW_KERNEL_AVX512(energyRowSobelL1AVX512, ENERGY_SOBEL_L1)
+__attribute__((target("avx512f,avx512bw"))) ENERGY_ROW16_KERNEL_AVX512(energyRow16SobelL1AVX512, ENERGY_SOBEL_L1)
+
+ENERGY_ROW_KERNEL_SCALAR(energyRowGradientScalar, unsigned int, ENERGY_GRADIENT)
+ENERGY_ROW_KERNEL_SCALAR(energyRow16GradientScalar, unsigned short, ENERGY_GRADIENT)
+__attribute__((target("sse4.2"))) ENERGY_ROW_KERNEL_SSE42(energyRowGradientSSE42, ENERGY_GRADIENT)
+__attribute__((target("sse4.2"))) ENERGY_ROW16_KERNEL_SSE42(energyRow16GradientSSE42, ENERGY_GRADIENT)
+__attribute__((target("avx2"))) ENERGY_ROW_KERNEL_AVX2(energyRowGradientAVX2, ENERGY_GRADIENT)
+__attribute__((target("avx2"))) ENERGY_ROW16_KERNEL_AVX2(energyRow16GradientAVX2, ENERGY_GRADIENT)
+__attribute__((target("avx512f"))) ENERGY_ROW_KERNEL_AVX512(energyRowGradientAVX512, ENERGY_GRADIENT)
+__attribute__((target("avx512f,avx512bw"))) ENERGY_ROW16_KERNEL_AVX512(energyRow16GradientAVX512, ENERGY_GRADIENT)
+
+/// @brief Energy row kernels by [energy function][tier]
+static const EnergyRowKernel energyRowKernels[PIXEL_ENERGY_FUNCTION_COUNT][SIMD_TIER_COUNT] =
+{
+    { energyRowSobelScalar,    energyRowSobelSSE42,    energyRowSobelAVX2,    energyRowSobelAVX512 },
+    { energyRowSobelL1Scalar,  energyRowSobelL1SSE42,  energyRowSobelL1AVX2,  energyRowSobelL1AVX512 },
+    { energyRowGradientScalar, energyRowGradientSSE42, energyRowGradientAVX2, energyRowGradientAVX512 },
+};
+
+/// @brief 16 bit energy row kernels by [energy function][tier]
+static const EnergyRow16Kernel energyRow16Kernels[PIXEL_ENERGY_FUNCTION_COUNT][SIMD_TIER_COUNT] =
+{
+    { energyRow16SobelScalar,    energyRow16SobelSSE42,    energyRow16SobelAVX2,    energyRow16SobelAVX512 },
+    { energyRow16SobelL1Scalar,  energyRow16SobelL1SSE42,  energyRow16SobelL1AVX2,  energyRow16SobelL1AVX512 },
+    { energyRow16GradientScalar, energyRow16GradientSSE42, energyRow16GradientAVX2, energyRow16GradientAVX512 },
+};
+
+/// @brief Branch-free unsigned min
+static inline unsigned int minU32(unsigned int a, unsigned int b)
+{
+    return a < b ? a : b;
+}
+
+/// @brief Direction code of a pixel, same tie-breaking as seamAnnotate
+static inline unsigned int seamDirection(unsigned int left, unsigned int center, unsigned int right)
+{
+    if (left < center && left < right)  return SEAM_DIR_LEFT;
+    if (right < center && right < left) return SEAM_DIR_RIGHT;
+    return SEAM_DIR_CENTER;
+}
+
+/// @brief Spread the low 16 bits of a mask to the even bits of a 32 bit word
+static inline unsigned int spreadBits16(unsigned int mask)
+{
+    mask = (mask | (mask << 8)) & 0x00FF00FF;
+    mask = (mask | (mask << 4)) & 0x0F0F0F0F;
+    mask = (mask | (mask << 2)) & 0x33333333;
+    mask = (mask | (mask << 1)) & 0x55555555;
+    return mask;
+}
+
+/// @brief Pack per-lane left/right masks into 2-bit direction codes (lanes outside laneMask get SEAM_DIR_LEFT)
+static inline unsigned int packDirections(unsigned int leftMask, unsigned int rightMask, unsigned int laneMask)
+{
+    return spreadBits16(~(leftMask | rightMask) & laneMask) | (spreadBits16(rightMask) << 1);
+}
+
+/// @brief SSE4.2 load of 4 energies of a 32 bit energy row
+__attribute__((target("sse4.2")))
+static inline __m128i loadEnergySSE42(const unsigned int* energy)
+{
+    return _mm_loadu_si128((const __m128i *) energy);
+}
+
+/// @brief SSE4.2 load of 4 energies of a 16 bit energy row, widened to 32 bit lanes
+__attribute__((target("sse4.2")))
+static inline __m128i loadEnergy16SSE42(const unsigned short* energy)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) energy));
+}
+
+/// @brief AVX2 load of 8 energies of a 32 bit energy row
+__attribute__((target("avx2")))
+static inline __m256i loadEnergyAVX2(const unsigned int* energy)
+{
+    return _mm256_loadu_si256((const __m256i *) energy);
+}
+
+/// @brief AVX2 load of 8 energies of a 16 bit energy row, widened to 32 bit lanes
+__attribute__((target("avx2")))
+static inline __m256i loadEnergy16AVX2(const unsigned short* energy)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) energy));
+}
+
+/// @brief AVX-512 masked load of 16 energies of a 32 bit energy row
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i loadEnergyAVX512(__mmask16 mask, const unsigned int* energy)
+{
+    return _mm512_maskz_loadu_epi32(mask, energy);
+}
+
+/// @brief AVX-512 masked load of 16 energies of a 16 bit energy row, widened to 32 bit lanes
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i loadEnergy16AVX512(__mmask16 mask, const unsigned short* energy)
+{
+    return _mm512_cvtepu16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16((__mmask32) mask, energy)));
+}
+
+/// DP row kernels:
+// - Every DP kernel exists for 32 bit and 16 bit energy rows (see "Compact energy"), the two only differ in how the
+//   energy is loaded, the cumulative energy and the min/compare lanes are 32 bit in both.
+#define DP_ROW_KERNEL_SCALAR(name, EnergyType)                                                                        \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        for (int x = xStart; x < xEnd; x++)                                                                           \
+        {                                                                                                             \
+            seamRow[x] = energyRow[x] + minU32(seamRowBelow[x - 1], minU32(seamRowBelow[x], seamRowBelow[x + 1]));    \
+        }                                                                                                             \
+    }
+
+// SSE4.2: 4 columns per step
+#define DP_ROW_KERNEL_SSE42(name, EnergyType, loadEnergy, tailKernel)                                                 \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        int x = xStart;                                                                                               \
+        for (; x + 4 <= xEnd; x += 4)                                                                                 \
+        {                                                                                                             \
+            __m128i left =   _mm_loadu_si128((const __m128i *) &seamRowBelow[x - 1]);                                 \
+            __m128i center = _mm_loadu_si128((const __m128i *) &seamRowBelow[x    ]);                                 \
+            __m128i right =  _mm_loadu_si128((const __m128i *) &seamRowBelow[x + 1]);                                 \
+            __m128i minEnergy = _mm_min_epu32(left, _mm_min_epu32(center, right));                                    \
+            _mm_storeu_si128((__m128i *) &seamRow[x], _mm_add_epi32(loadEnergy(&energyRow[x]), minEnergy));           \
+        }                                                                                                             \
+        tailKernel(seamRowBelow, energyRow, seamRow, x, xEnd);                                                        \
+    }
+
+// AVX2: 8 columns per step
+#define DP_ROW_KERNEL_AVX2(name, EnergyType, loadEnergy, tailKernel)                                                  \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        int x = xStart;                                                                                               \
+        for (; x + 8 <= xEnd; x += 8)                                                                                 \
+        {                                                                                                             \
+            __m256i left =   _mm256_loadu_si256((const __m256i *) &seamRowBelow[x - 1]);                              \
+            __m256i center = _mm256_loadu_si256((const __m256i *) &seamRowBelow[x    ]);                              \
+            __m256i right =  _mm256_loadu_si256((const __m256i *) &seamRowBelow[x + 1]);                              \
+            __m256i minEnergy = _mm256_min_epu32(left, _mm256_min_epu32(center, right));                              \
+            _mm256_storeu_si256((__m256i *) &seamRow[x], _mm256_add_epi32(loadEnergy(&energyRow[x]), minEnergy));     \
+        }                                                                                                             \
+        tailKernel(seamRowBelow, energyRow, seamRow, x, xEnd);                                                        \
+    }
+
+// AVX-512: 16 columns per step, masked tail
+#define DP_ROW_KERNEL_AVX512(name, EnergyType, loadEnergy)                                                            \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        for (int x = xStart; x < xEnd; x += 16)                                                                       \
+        {                                                                                                             \
+            __mmask16 mask = xEnd - x >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << (xEnd - x)) - 1);              \
+            __m512i left =   _mm512_maskz_loadu_epi32(mask, &seamRowBelow[x - 1]);                                    \
+            __m512i center = _mm512_maskz_loadu_epi32(mask, &seamRowBelow[x    ]);                                    \
+            __m512i right =  _mm512_maskz_loadu_epi32(mask, &seamRowBelow[x + 1]);                                    \
+            __m512i minEnergy = _mm512_min_epu32(left, _mm512_min_epu32(center, right));                              \
+            _mm512_mask_storeu_epi32(&seamRow[x], mask, _mm512_add_epi32(loadEnergy(mask, &energyRow[x]), minEnergy)); \
+        }                                                                                                             \
+    }
+
+// Scalar with directions
+#define DP_ROW_DIRECTIONS_KERNEL_SCALAR(name, EnergyType)                                                             \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        for (int x = xStart; x < xEnd; x++)                                                                           \
+        {                                                                                                             \
+            unsigned int left = seamRowBelow[x - 1];                                                                  \
+            unsigned int center = seamRowBelow[x];                                                                    \
+            unsigned int right = seamRowBelow[x + 1];                                                                 \
+            seamRow[x] = energyRow[x] + minU32(left, minU32(center, right));                                          \
+                                                                                                                      \
+            int shift = (x & 3) * 2;                                                                                  \
+            directionRow[x >> 2] = (unsigned char) ((directionRow[x >> 2] & ~(3 << shift)) | (seamDirection(left, center, right) << shift)); \
+        }                                                                                                             \
+    }
+
+// SSE4.2 with directions: 4 columns = 1 direction byte per step
+#define DP_ROW_DIRECTIONS_KERNEL_SSE42(name, EnergyType, loadEnergy, tailKernel)                                      \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        int x = xStart;                                                                                               \
+        for (; x + 4 <= xEnd; x += 4)                                                                                 \
+        {                                                                                                             \
+            __m128i left =   _mm_loadu_si128((const __m128i *) &seamRowBelow[x - 1]);                                 \
+            __m128i center = _mm_loadu_si128((const __m128i *) &seamRowBelow[x    ]);                                 \
+            __m128i right =  _mm_loadu_si128((const __m128i *) &seamRowBelow[x + 1]);                                 \
+            __m128i minEnergy = _mm_min_epu32(left, _mm_min_epu32(center, right));                                    \
+            _mm_storeu_si128((__m128i *) &seamRow[x], _mm_add_epi32(loadEnergy(&energyRow[x]), minEnergy));           \
+                                                                                                                      \
+            __m128i isLeft = _mm_and_si128(_mm_cmplt_epi32(left, center), _mm_cmplt_epi32(left, right));              \
+            __m128i isRight = _mm_and_si128(_mm_cmplt_epi32(right, center), _mm_cmplt_epi32(right, left));            \
+            directionRow[x >> 2] = (unsigned char) packDirections(_mm_movemask_ps(_mm_castsi128_ps(isLeft)),          \
+                                                                  _mm_movemask_ps(_mm_castsi128_ps(isRight)), 0xF);   \
+        }                                                                                                             \
+        tailKernel(seamRowBelow, energyRow, seamRow, directionRow, x, xEnd);                                          \
+    }
+
+// AVX2 with directions: 8 columns = 2 direction bytes per step
+#define DP_ROW_DIRECTIONS_KERNEL_AVX2(name, EnergyType, loadEnergy, tailKernel)                                       \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        int x = xStart;                                                                                               \
+        for (; x + 8 <= xEnd; x += 8)                                                                                 \
+        {                                                                                                             \
+            __m256i left =   _mm256_loadu_si256((const __m256i *) &seamRowBelow[x - 1]);                              \
+            __m256i center = _mm256_loadu_si256((const __m256i *) &seamRowBelow[x    ]);                              \
+            __m256i right =  _mm256_loadu_si256((const __m256i *) &seamRowBelow[x + 1]);                              \
+            __m256i minEnergy = _mm256_min_epu32(left, _mm256_min_epu32(center, right));                              \
+            _mm256_storeu_si256((__m256i *) &seamRow[x], _mm256_add_epi32(loadEnergy(&energyRow[x]), minEnergy));     \
+                                                                                                                      \
+            __m256i isLeft = _mm256_and_si256(_mm256_cmpgt_epi32(center, left), _mm256_cmpgt_epi32(right, left));     \
+            __m256i isRight = _mm256_and_si256(_mm256_cmpgt_epi32(center, right), _mm256_cmpgt_epi32(left, right));   \
+            unsigned short codes = (unsigned short) packDirections(_mm256_movemask_ps(_mm256_castsi256_ps(isLeft)),   \
+                                                                   _mm256_movemask_ps(_mm256_castsi256_ps(isRight)), 0xFF); \
+            memcpy(&directionRow[x >> 2], &codes, sizeof(codes));                                                     \
+        }                                                                                                             \
+        tailKernel(seamRowBelow, energyRow, seamRow, directionRow, x, xEnd);                                          \
+    }
+
+// AVX-512 with directions: 16 columns = 4 direction bytes per step, masked tail
+#define DP_ROW_DIRECTIONS_KERNEL_AVX512(name, EnergyType, loadEnergy)                                                 \
+    static void name(const unsigned int* seamRowBelow, const EnergyType* energyRow, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd) \
+    {                                                                                                                 \
+        for (int x = xStart; x < xEnd; x += 16)                                                                       \
+        {                                                                                                             \
+            int laneCount = xEnd - x >= 16 ? 16 : xEnd - x;                                                           \
+            __mmask16 mask = (__mmask16) ((1u << laneCount) - 1);                                                     \
+            __m512i left =   _mm512_maskz_loadu_epi32(mask, &seamRowBelow[x - 1]);                                    \
+            __m512i center = _mm512_maskz_loadu_epi32(mask, &seamRowBelow[x    ]);                                    \
+            __m512i right =  _mm512_maskz_loadu_epi32(mask, &seamRowBelow[x + 1]);                                    \
+            __m512i minEnergy = _mm512_min_epu32(left, _mm512_min_epu32(center, right));                              \
+            _mm512_mask_storeu_epi32(&seamRow[x], mask, _mm512_add_epi32(loadEnergy(mask, &energyRow[x]), minEnergy)); \
+                                                                                                                      \
+            __mmask16 isLeft = _mm512_mask_cmplt_epu32_mask(_mm512_cmplt_epu32_mask(left, center), left, right);      \
+            __mmask16 isRight = _mm512_mask_cmplt_epu32_mask(_mm512_cmplt_epu32_mask(right, center), right, left);    \
+            unsigned int codes = packDirections(isLeft, isRight, mask);                                               \
+            memcpy(&directionRow[x >> 2], &codes, (laneCount + 3) / 4);                                               \
+        }                                                                                                             \
+    }
+
+DP_ROW_KERNEL_SCALAR(dpRowScalar, unsigned int)
+DP_ROW_KERNEL_SCALAR(dpRow16Scalar, unsigned short)
+__attribute__((target("sse4.2"))) DP_ROW_KERNEL_SSE42(dpRowSSE42, unsigned int, loadEnergySSE42, dpRowScalar)
+__attribute__((target("sse4.2"))) DP_ROW_KERNEL_SSE42(dpRow16SSE42, unsigned short, loadEnergy16SSE42, dpRow16Scalar)
+__attribute__((target("avx2"))) DP_ROW_KERNEL_AVX2(dpRowAVX2, unsigned int, loadEnergyAVX2, dpRowScalar)
+__attribute__((target("avx2"))) DP_ROW_KERNEL_AVX2(dpRow16AVX2, unsigned short, loadEnergy16AVX2, dpRow16Scalar)
+__attribute__((target("avx512f,avx512bw"))) DP_ROW_KERNEL_AVX512(dpRowAVX512, unsigned int, loadEnergyAVX512)
+__attribute__((target("avx512f,avx512bw"))) DP_ROW_KERNEL_AVX512(dpRow16AVX512, unsigned short, loadEnergy16AVX512)
+
+DP_ROW_DIRECTIONS_KERNEL_SCALAR(dpRowDirectionsScalar, unsigned int)
+DP_ROW_DIRECTIONS_KERNEL_SCALAR(dpRowDirections16Scalar, unsigned short)
+__attribute__((target("sse4.2"))) DP_ROW_DIRECTIONS_KERNEL_SSE42(dpRowDirectionsSSE42, unsigned int, loadEnergySSE42, dpRowDirectionsScalar)
+__attribute__((target("sse4.2"))) DP_ROW_DIRECTIONS_KERNEL_SSE42(dpRowDirections16SSE42, unsigned short, loadEnergy16SSE42, dpRowDirections16Scalar)
+__attribute__((target("avx2"))) DP_ROW_DIRECTIONS_KERNEL_AVX2(dpRowDirectionsAVX2, unsigned int, loadEnergyAVX2, dpRowDirectionsScalar)
+__attribute__((target("avx2"))) DP_ROW_DIRECTIONS_KERNEL_AVX2(dpRowDirections16AVX2, unsigned short, loadEnergy16AVX2, dpRowDirections16Scalar)
+__attribute__((target("avx512f,avx512bw"))) DP_ROW_DIRECTIONS_KERNEL_AVX512(dpRowDirectionsAVX512, unsigned int, loadEnergyAVX512)
+__attribute__((target("avx512f,avx512bw"))) DP_ROW_DIRECTIONS_KERNEL_AVX512(dpRowDirections16AVX512, unsigned short, loadEnergy16AVX512)
+
+/// Forward energy kernels:
+// - Forward energy (Rubinstein et al. 2008) charges a pixel for the new edges its removal creates instead of for its own
+//   gradient. The DP runs bottom-up, so the seam continues from (x, y) to a child in row y + 1: removing (x, y) joins
+//   its left and right neighbour (costUp = |I(x + 1, y) - I(x - 1, y)|), continuing to the left or right child also
+//   joins I(x, y + 1) with the left or right neighbour (costLeft = costUp + |I(x, y + 1) - I(x - 1, y)|, costRight =
+//   costUp + |I(x, y + 1) - I(x + 1, y)|).
+// - The cost of a pixel depends on the direction, so there is no energy plane: the costs of a row are calculated from
+//   a ring of padded rows (y and y + 1) just before its DP row, and the seam is backtracked through the direction map.
+// - The costs are summed over the energy channels (at most 3 * 510 = 1530 per pixel and direction). A guard plus a
+//   cost is more than INT_MAX, so the direction masks are built from unsigned mins and equality compares.
+
+/// @brief Scalar forward costs of the pixels [xStart, xEnd) of row y from the padded planes
+static inline void forwardCostScalar(const PaddedImage* padded, unsigned int* costUp, unsigned int* costLeft, unsigned int* costRight, int y, int xStart, int xEnd)
+{
+    for (int x = xStart; x < xEnd; x++)
+    {
+        unsigned int up = 0;
+        unsigned int left = 0;
+        unsigned int right = 0;
+        for (int channel = 0; channel < padded->channelCount; channel++)
+        {
+            const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+            const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+            up += abs(r1[2] - r1[0]);
+            left += abs(r2[1] - r1[0]);
+            right += abs(r2[1] - r1[2]);
+        }
+
+        costUp[x] = up;
+        costLeft[x] = up + left;
+        costRight[x] = up + right;
+    }
+}
+
+/// @brief Scalar forward costs of row y
+static void forwardCostRowScalar(const PaddedImage* padded, unsigned int* costUp, unsigned int* costLeft, unsigned int* costRight, int y)
+{
+    forwardCostScalar(padded, costUp, costLeft, costRight, y, 0, padded->width);
+}
+
+/// @brief SSE4.2 forward costs of row y (4 pixels per step)
+__attribute__((target("sse4.2")))
+static void forwardCostRowSSE42(const PaddedImage* padded, unsigned int* costUp, unsigned int* costLeft, unsigned int* costRight, int y)
+{
+    const int width = padded->width;
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i up = _mm_setzero_si128();
+        __m128i left = _mm_setzero_si128();
+        __m128i right = _mm_setzero_si128();
+        for (int channel = 0; channel < padded->channelCount; channel++)
+        {
+            const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+            const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+            __m128i d = loadBytes4SSE42(r1);
+            __m128i f = loadBytes4SSE42(r1 + 2);
+            __m128i h = loadBytes4SSE42(r2 + 1);
+            up = _mm_add_epi32(up, _mm_abs_epi32(_mm_sub_epi32(f, d)));
+            left = _mm_add_epi32(left, _mm_abs_epi32(_mm_sub_epi32(h, d)));
+            right = _mm_add_epi32(right, _mm_abs_epi32(_mm_sub_epi32(h, f)));
+        }
+
+        _mm_storeu_si128((__m128i *) &costUp[x], up);
+        _mm_storeu_si128((__m128i *) &costLeft[x], _mm_add_epi32(up, left));
+        _mm_storeu_si128((__m128i *) &costRight[x], _mm_add_epi32(up, right));
+    }
+
+    // Remainder of the row
+    forwardCostScalar(padded, costUp, costLeft, costRight, y, x, width);
+}
+
+/// @brief AVX2 forward costs of row y (8 pixels per step)
+__attribute__((target("avx2")))
+static void forwardCostRowAVX2(const PaddedImage* padded, unsigned int* costUp, unsigned int* costLeft, unsigned int* costRight, int y)
+{
+    const int width = padded->width;
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i up = _mm256_setzero_si256();
+        __m256i left = _mm256_setzero_si256();
+        __m256i right = _mm256_setzero_si256();
+        for (int channel = 0; channel < padded->channelCount; channel++)
+        {
+            const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+            const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+            __m256i d = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r1    )));
+            __m256i f = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r1 + 2)));
+            __m256i h = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (r2 + 1)));
+            up = _mm256_add_epi32(up, _mm256_abs_epi32(_mm256_sub_epi32(f, d)));
+            left = _mm256_add_epi32(left, _mm256_abs_epi32(_mm256_sub_epi32(h, d)));
+            right = _mm256_add_epi32(right, _mm256_abs_epi32(_mm256_sub_epi32(h, f)));
+        }
+
+        _mm256_storeu_si256((__m256i *) &costUp[x], up);
+        _mm256_storeu_si256((__m256i *) &costLeft[x], _mm256_add_epi32(up, left));
+        _mm256_storeu_si256((__m256i *) &costRight[x], _mm256_add_epi32(up, right));
+    }
+
+    // Remainder of the row
+    forwardCostScalar(padded, costUp, costLeft, costRight, y, x, width);
+}
+
+/// @brief AVX-512 forward costs of row y (16 pixels per step, masked tail)
+__attribute__((target("avx512f")))
+static void forwardCostRowAVX512(const PaddedImage* padded, unsigned int* costUp, unsigned int* costLeft, unsigned int* costRight, int y)
+{
+    const int width = padded->width;
+
+    for (int x = 0; x < width; x += 16)
+    {
+        __mmask16 storeMask = width - x >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << (width - x)) - 1);
+        __m512i up = _mm512_setzero_si512();
+        __m512i left = _mm512_setzero_si512();
+        __m512i right = _mm512_setzero_si512();
+        for (int channel = 0; channel < padded->channelCount; channel++)
+        {
+            const unsigned char* r1 = getPaddedRow(padded, channel, y    ) + x;
+            const unsigned char* r2 = getPaddedRow(padded, channel, y + 1) + x;
+
+            __m512i d = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r1    )));
+            __m512i f = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r1 + 2)));
+            __m512i h = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) (r2 + 1)));
+            up = _mm512_add_epi32(up, _mm512_abs_epi32(_mm512_sub_epi32(f, d)));
+            left = _mm512_add_epi32(left, _mm512_abs_epi32(_mm512_sub_epi32(h, d)));
+            right = _mm512_add_epi32(right, _mm512_abs_epi32(_mm512_sub_epi32(h, f)));
+        }
+
+        _mm512_mask_storeu_epi32(&costUp[x], storeMask, up);
+        _mm512_mask_storeu_epi32(&costLeft[x], storeMask, _mm512_add_epi32(up, left));
+        _mm512_mask_storeu_epi32(&costRight[x], storeMask, _mm512_add_epi32(up, right));
+    }
+}
+
+/// @brief Scalar forward DP row with directions
+static void dpRowForwardScalar(const unsigned int* seamRowBelow, const unsigned int* costUp, const unsigned int* costLeft, const unsigned int* costRight, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd)
+{
+    for (int x = xStart; x < xEnd; x++)
+    {
+        unsigned int left = seamRowBelow[x - 1] + costLeft[x];
+        unsigned int center = seamRowBelow[x] + costUp[x];
+        unsigned int right = seamRowBelow[x + 1] + costRight[x];
+        seamRow[x] = minU32(left, minU32(center, right));
+
+        int shift = (x & 3) * 2;
+        directionRow[x >> 2] = (unsigned char) ((directionRow[x >> 2] & ~(3 << shift)) | (seamDirection(left, center, right) << shift));
+    }
+}
+
+/// @brief SSE4.2 forward DP row with directions (4 columns = 1 direction byte per step)
+__attribute__((target("sse4.2")))
+static void dpRowForwardSSE42(const unsigned int* seamRowBelow, const unsigned int* costUp, const unsigned int* costLeft, const unsigned int* costRight, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd)
+{
+    int x = xStart;
+    for (; x + 4 <= xEnd; x += 4)
+    {
+        __m128i left =   _mm_add_epi32(_mm_loadu_si128((const __m128i *) &seamRowBelow[x - 1]), _mm_loadu_si128((const __m128i *) &costLeft[x]));
+        __m128i center = _mm_add_epi32(_mm_loadu_si128((const __m128i *) &seamRowBelow[x    ]), _mm_loadu_si128((const __m128i *) &costUp[x]));
+        __m128i right =  _mm_add_epi32(_mm_loadu_si128((const __m128i *) &seamRowBelow[x + 1]), _mm_loadu_si128((const __m128i *) &costRight[x]));
+        __m128i minEnergy = _mm_min_epu32(left, _mm_min_epu32(center, right));
+        _mm_storeu_si128((__m128i *) &seamRow[x], minEnergy);
+
+        // Strictly smaller than both others == the min and equal to neither
+        __m128i isLeft = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(left, center), _mm_cmpeq_epi32(left, right)), _mm_cmpeq_epi32(left, minEnergy));
+        __m128i isRight = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(right, center), _mm_cmpeq_epi32(right, left)), _mm_cmpeq_epi32(right, minEnergy));
+        directionRow[x >> 2] = (unsigned char) packDirections(_mm_movemask_ps(_mm_castsi128_ps(isLeft)),
+                                                              _mm_movemask_ps(_mm_castsi128_ps(isRight)), 0xF);
+    }
+    dpRowForwardScalar(seamRowBelow, costUp, costLeft, costRight, seamRow, directionRow, x, xEnd);
+}
+
+/// @brief AVX2 forward DP row with directions (8 columns = 2 direction bytes per step)
+__attribute__((target("avx2")))
+static void dpRowForwardAVX2(const unsigned int* seamRowBelow, const unsigned int* costUp, const unsigned int* costLeft, const unsigned int* costRight, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd)
+{
+    int x = xStart;
+    for (; x + 8 <= xEnd; x += 8)
+    {
+        __m256i left =   _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &seamRowBelow[x - 1]), _mm256_loadu_si256((const __m256i *) &costLeft[x]));
+        __m256i center = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &seamRowBelow[x    ]), _mm256_loadu_si256((const __m256i *) &costUp[x]));
+        __m256i right =  _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &seamRowBelow[x + 1]), _mm256_loadu_si256((const __m256i *) &costRight[x]));
+        __m256i minEnergy = _mm256_min_epu32(left, _mm256_min_epu32(center, right));
+        _mm256_storeu_si256((__m256i *) &seamRow[x], minEnergy);
+
+        __m256i isLeft = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(left, center), _mm256_cmpeq_epi32(left, right)), _mm256_cmpeq_epi32(left, minEnergy));
+        __m256i isRight = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(right, center), _mm256_cmpeq_epi32(right, left)), _mm256_cmpeq_epi32(right, minEnergy));
+        unsigned short codes = (unsigned short) packDirections(_mm256_movemask_ps(_mm256_castsi256_ps(isLeft)),
+                                                               _mm256_movemask_ps(_mm256_castsi256_ps(isRight)), 0xFF);
+        memcpy(&directionRow[x >> 2], &codes, sizeof(codes));
+    }
+    dpRowForwardScalar(seamRowBelow, costUp, costLeft, costRight, seamRow, directionRow, x, xEnd);
+}
+
+/// @brief AVX-512 forward DP row with directions (16 columns = 4 direction bytes per step, masked tail)
+__attribute__((target("avx512f")))
+static void dpRowForwardAVX512(const unsigned int* seamRowBelow, const unsigned int* costUp, const unsigned int* costLeft, const unsigned int* costRight, unsigned int* seamRow, unsigned char* directionRow, int xStart, int xEnd)
+{
+    for (int x = xStart; x < xEnd; x += 16)
+    {
+        int laneCount = xEnd - x >= 16 ? 16 : xEnd - x;
+        __mmask16 mask = (__mmask16) ((1u << laneCount) - 1);
+        __m512i left =   _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, &seamRowBelow[x - 1]), _mm512_maskz_loadu_epi32(mask, &costLeft[x]));
+        __m512i center = _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, &seamRowBelow[x    ]), _mm512_maskz_loadu_epi32(mask, &costUp[x]));
+        __m512i right =  _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, &seamRowBelow[x + 1]), _mm512_maskz_loadu_epi32(mask, &costRight[x]));
+        _mm512_mask_storeu_epi32(&seamRow[x], mask, _mm512_min_epu32(left, _mm512_min_epu32(center, right)));
+
+        __mmask16 isLeft = _mm512_mask_cmplt_epu32_mask(_mm512_cmplt_epu32_mask(left, center), left, right);
+        __mmask16 isRight = _mm512_mask_cmplt_epu32_mask(_mm512_cmplt_epu32_mask(right, center), right, left);
+        unsigned int codes = packDirections(isLeft, isRight, mask);
+        memcpy(&directionRow[x >> 2], &codes, (laneCount + 3) / 4);
+    }
+}
+
+/// Seam remove kernels:
+// - A row is copied in segments between the removed seam pixels. Each tier copies a segment with its own vector
+//   width, the scalar tier keeps the byte-by-byte copy of the original seamRemove as the reference.
+#define SEAM_REMOVE_ROW_KERNEL(name, copySegment)                                                                     \
+    static void name(const unsigned char* srcRow, unsigned char* dstRow, const int* seamX, int seamCount, int width, int channelCount) \
+    {                                                                                                                 \
+        int srcStart = 0;                                                                                             \
+        int dstStart = 0;                                                                                             \
+        for (int seamIdx = 0; seamIdx <= seamCount; seamIdx++)                                                        \
+        {                                                                                                             \
+            int srcEnd = (seamIdx < seamCount ? seamX[seamIdx] : width) * channelCount;                               \
+            copySegment(&dstRow[dstStart], &srcRow[srcStart], srcEnd - srcStart);                                     \
+            dstStart += srcEnd - srcStart;                                                                            \
+            srcStart = srcEnd + channelCount;                                                                         \
+        }                                                                                                             \
+    }
+
+/// @brief Scalar byte copy
+static inline void copyBytesScalar(unsigned char* dst, const unsigned char* src, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+/// @brief SSE4.2 copy (16 bytes per step)
+__attribute__((target("sse4.2")))
+static inline void copyBytesSSE42(unsigned char* dst, const unsigned char* src, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm_storeu_si128((__m128i *) &dst[i], _mm_loadu_si128((const __m128i *) &src[i]));
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+/// @brief AVX2 copy (32 bytes per step)
+__attribute__((target("avx2")))
+static inline void copyBytesAVX2(unsigned char* dst, const unsigned char* src, int count)
+{
+    int i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        _mm256_storeu_si256((__m256i *) &dst[i], _mm256_loadu_si256((const __m256i *) &src[i]));
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+/// @brief AVX-512 copy (64 bytes per step, masked tail)
+__attribute__((target("avx512f,avx512bw")))
+static inline void copyBytesAVX512(unsigned char* dst, const unsigned char* src, int count)
+{
+    for (int i = 0; i < count; i += 64)
+    {
+        __mmask64 mask = count - i >= 64 ? ~(__mmask64) 0 : (((__mmask64) 1 << (count - i)) - 1);
+        _mm512_mask_storeu_epi8(&dst[i], mask, _mm512_maskz_loadu_epi8(mask, &src[i]));
+    }
+}
+
+SEAM_REMOVE_ROW_KERNEL(seamRemoveRowScalar, copyBytesScalar)
+__attribute__((target("sse4.2"))) SEAM_REMOVE_ROW_KERNEL(seamRemoveRowSSE42, copyBytesSSE42)
+__attribute__((target("avx2"))) SEAM_REMOVE_ROW_KERNEL(seamRemoveRowAVX2, copyBytesAVX2)
+__attribute__((target("avx512f,avx512bw"))) SEAM_REMOVE_ROW_KERNEL(seamRemoveRowAVX512, copyBytesAVX512)
+
+/// @brief Highest tier the CPU can run
+static inline SimdTier detectSimdTier(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return SIMD_TIER_AVX512;
+    if (__builtin_cpu_supports("avx2"))                                          return SIMD_TIER_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))                                        return SIMD_TIER_SSE42;
+    return SIMD_TIER_SCALAR;
+}
+
+/// @brief Select the energy row kernels of an energy function for the selected tier (forward energy keeps the sobel
+/// kernels, it has no per pixel energy)
+static inline void seamKernelsSelectEnergy(EnergyFunction energyFunction)
+{
+    const int function = energyFunction < PIXEL_ENERGY_FUNCTION_COUNT ? energyFunction : ENERGY_SOBEL;
+    seamKernels.energyFunction = energyFunction;
+    seamKernels.energyRow = energyRowKernels[function][seamKernels.tier];
+    seamKernels.energyRow16 = energyRow16Kernels[function][seamKernels.tier];
+}
+
+/// @brief Select the kernels of the best supported tier (or the one forced by SEAM_CARVING_SIMD)
+static inline void seamKernelsInit(void)
+{
+    SimdTier tier = detectSimdTier();
+
+    const char* forcedTierName = getenv(SIMD_TIER_ENV);
+    if (forcedTierName != NULL && forcedTierName[0] != '\0')
+    {
+        int forcedTier = -1;
+        for (int t = 0; t < SIMD_TIER_COUNT; t++)
+        {
+            if (strcmp(forcedTierName, simdTierNames[t]) == 0) forcedTier = t;
+        }
+
+        if (forcedTier < 0)
+            printf("Warning: Unknown %s=%s, using %s.\n", SIMD_TIER_ENV, forcedTierName, simdTierNames[tier]);
+        else if (forcedTier > (int) tier)
+            printf("Warning: CPU doesn't support %s=%s, using %s.\n", SIMD_TIER_ENV, forcedTierName, simdTierNames[tier]);
+        else
+            tier = (SimdTier) forcedTier;
+    }
+
+    seamKernels.tier = tier;
+    switch (tier)
+    {
+        case SIMD_TIER_AVX512:
+            seamKernels.dpRow = dpRowAVX512;
+            seamKernels.dpRowDirections = dpRowDirectionsAVX512;
+            seamKernels.dpRow16 = dpRow16AVX512;
+            seamKernels.dpRowDirections16 = dpRowDirections16AVX512;
+            seamKernels.forwardCostRow = forwardCostRowAVX512;
+            seamKernels.dpRowForward = dpRowForwardAVX512;
+            seamKernels.seamRemoveRow = seamRemoveRowAVX512;
+            break;
+        case SIMD_TIER_AVX2:
+            seamKernels.dpRow = dpRowAVX2;
+            seamKernels.dpRowDirections = dpRowDirectionsAVX2;
+            seamKernels.dpRow16 = dpRow16AVX2;
+            seamKernels.dpRowDirections16 = dpRowDirections16AVX2;
+            seamKernels.forwardCostRow = forwardCostRowAVX2;
+            seamKernels.dpRowForward = dpRowForwardAVX2;
+            seamKernels.seamRemoveRow = seamRemoveRowAVX2;
+            break;
+        case SIMD_TIER_SSE42:
+            seamKernels.dpRow = dpRowSSE42;
+            seamKernels.dpRowDirections = dpRowDirectionsSSE42;
+            seamKernels.dpRow16 = dpRow16SSE42;
+            seamKernels.dpRowDirections16 = dpRowDirections16SSE42;
+            seamKernels.forwardCostRow = forwardCostRowSSE42;
+            seamKernels.dpRowForward = dpRowForwardSSE42;
+            seamKernels.seamRemoveRow = seamRemoveRowSSE42;
+            break;
+        default:
+            seamKernels.dpRow = dpRowScalar;
+            seamKernels.dpRowDirections = dpRowDirectionsScalar;
+            seamKernels.dpRow16 = dpRow16Scalar;
+            seamKernels.dpRowDirections16 = dpRowDirections16Scalar;
+            seamKernels.forwardCostRow = forwardCostRowScalar;
+            seamKernels.dpRowForward = dpRowForwardScalar;
+            seamKernels.seamRemoveRow = seamRemoveRowScalar;
+            break;
+    }
+    seamKernelsSelectEnergy(ENERGY_SOBEL);
+}
+
+#endif // SEAM_CARVING_KERNELS_H